@@ -438,16 +438,21 @@ void do_bad_area(unsigned long addr, unsigned int fsr, struct pt_regs *regs)
  * If we encountered a write fault, we must have write permission, otherwise
  * we allow any permission.
  */
-static inline bool access_error(unsigned int fsr, struct vm_area_struct *vma)
+static inline unsigned long fault_access_mask(unsigned int fsr)
 {
-	unsigned int mask = VM_READ | VM_WRITE | VM_EXEC;
+	unsigned long mask = VM_READ | VM_WRITE | VM_EXEC;
 
 	if (fsr & FSR_WRITE)
 		mask = VM_WRITE;
 	if (fsr & FSR_LNX_PF)
 		mask = VM_EXEC;
 
-	return vma->vm_flags & mask ? false : true;
+	return mask;
+}
+
+static inline bool access_error(unsigned int fsr, struct vm_area_struct *vma)
+{
+	return vma->vm_flags & fault_access_mask(fsr) ? false : true;
 }
 
 static int __kprobes
@@ -512,6 +517,30 @@ do_page_fault(unsigned long addr, unsigned int fsr, struct pt_regs *regs)
 	if (in_atomic() || !mm)
 		goto no_context;
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/*
+	 * Try to get away without mmap_sem first, so that our faults do
+	 * not wait for another thread's mmap() or munmap().
+	 */
+	if (user_mode(regs)) {
+		fault = handle_speculative_fault(mm, addr & PAGE_MASK, flags,
+						 fault_access_mask(fsr));
+		if (!(fault & VM_FAULT_RETRY)) {
+			perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS, 1, regs, addr);
+			if (fault & VM_FAULT_MAJOR) {
+				tsk->maj_flt++;
+				perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MAJ, 1,
+						regs, addr);
+			} else {
+				tsk->min_flt++;
+				perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1,
+						regs, addr);
+			}
+			return 0;
+		}
+	}
+#endif
+
 	/*
 	 * As per x86, we may deadlock here.  However, since the kernel only
 	 * validly references user space from well defined areas of the code,
@@ -37,6 +37,11 @@
 #include <linux/swap.h>
 #include <linux/mm_types.h>
 #include <linux/dma-contiguous.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <trace/events/kmem.h>
 
 #ifndef SZ_1M
@@ -49,10 +54,49 @@ struct cma {
 	unsigned long	*bitmap;
 	bool in_system;
 	struct mutex lock;
+
+	/* pre-draining, see dma_contiguous_prepare() */
+	struct work_struct drain_work;
+	struct delayed_work drain_timeout;
+	unsigned long drain_pfn;
+	unsigned long drain_count;
+	bool drain_armed;
 };
 
 static DEFINE_MUTEX(cma_mutex);
 
+/*
+ * How long movable allocations are kept off CMA pageblocks after a
+ * client announced an allocation with dma_contiguous_prepare().
+ */
+static u32 cma_drain_hold_ms = 1000;
+
+/* cma_alloc latency histogram, bucket n >= 1 counts [2^(n-1), 2^n) ms */
+#define CMA_LATENCY_BUCKETS	12
+
+static struct cma_stats {
+	atomic_t	allocs;
+	atomic_t	failures;
+	atomic_t	migrate_failures;
+	atomic_t	drains;
+	atomic_t	drain_failures;
+	atomic_t	latency[CMA_LATENCY_BUCKETS];
+} cma_stats;
+
+static void cma_account_alloc(bool success, unsigned long usecs)
+{
+	unsigned long msecs = usecs / USEC_PER_MSEC;
+	int bucket = 0;
+
+	if (msecs)
+		bucket = min(ilog2(msecs) + 1, CMA_LATENCY_BUCKETS - 1);
+
+	atomic_inc(&cma_stats.allocs);
+	if (!success)
+		atomic_inc(&cma_stats.failures);
+	atomic_inc(&cma_stats.latency[bucket]);
+}
+
 struct cma *dma_contiguous_def_area;
 phys_addr_t dma_contiguous_def_base;
 
@@ -171,6 +215,64 @@ static __init int cma_activate_area(unsigned long base_pfn, unsigned long count)
 	return 0;
 }
 
+static void cma_drain_release(struct cma *cma)
+{
+	mutex_lock(&cma->lock);
+	if (cma->drain_armed) {
+		cma->drain_armed = false;
+		cma_release_movable(cma->base_pfn);
+	}
+	mutex_unlock(&cma->lock);
+}
+
+static void cma_drain_timeout(struct work_struct *work)
+{
+	struct cma *cma = container_of(to_delayed_work(work), struct cma,
+				       drain_timeout);
+
+	cma_drain_release(cma);
+}
+
+static void cma_drain_work(struct work_struct *work)
+{
+	struct cma *cma = container_of(work, struct cma, drain_work);
+	unsigned long start, end, pfn, next;
+	ktime_t begin = ktime_get();
+	int ret = 0;
+
+	mutex_lock(&cma->lock);
+	start = cma->drain_pfn;
+	end = start + cma->drain_count;
+	mutex_unlock(&cma->lock);
+
+	atomic_inc(&cma_stats.drains);
+
+	/*
+	 * Drain in MAX_ORDER sized chunks and drop cma_mutex in between,
+	 * so the allocation this is preparing for never waits for more
+	 * than one chunk.
+	 */
+	for (pfn = start; pfn < end; pfn = next) {
+		next = min(ALIGN(pfn + 1, MAX_ORDER_NR_PAGES), end);
+
+		/* The allocation happened or the hold expired */
+		if (!ACCESS_ONCE(cma->drain_armed))
+			break;
+
+		mutex_lock(&cma_mutex);
+		ret = drain_contig_range(pfn, next, MIGRATE_CMA);
+		mutex_unlock(&cma_mutex);
+		if (ret) {
+			trace_cma_migrate_fail(pfn, next - pfn, ret);
+			atomic_inc(&cma_stats.drain_failures);
+		}
+		cond_resched();
+	}
+
+	trace_cma_drain(start, end - start, ret,
+			ktime_us_delta(ktime_get(), begin));
+}
+
 static __init struct cma *cma_create_area(unsigned long base_pfn,
 				     unsigned long count, bool system)
 {
@@ -198,6 +300,9 @@ static __init struct cma *cma_create_area(unsigned long base_pfn,
 			goto error;
 	}
 	mutex_init(&cma->lock);
+	INIT_WORK(&cma->drain_work, cma_drain_work);
+	INIT_DELAYED_WORK(&cma->drain_timeout, cma_drain_timeout);
+	cma->drain_armed = false;
 
 	pr_debug("%s: returned %p\n", __func__, (void *)cma);
 	return cma;
@@ -497,6 +602,8 @@ struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 	unsigned long mask, pfn, pageno, start = 0;
 	struct cma *cma = dev_get_cma_area(dev);
 	struct page *page = NULL;
+	unsigned long usecs;
+	ktime_t begin;
 	int ret = 0;
 	int tries = 0;
 
@@ -514,6 +621,8 @@ struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 
 	mask = (1 << align) - 1;
 
+	trace_cma_alloc_start(count, align);
+	begin = ktime_get();
 
 	for (;;) {
 		mutex_lock(&cma->lock);
@@ -539,7 +648,11 @@ struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 		if (ret == 0) {
 			page = pfn_to_page(pfn);
 			break;
-		} else if (ret != -EBUSY) {
+		}
+
+		trace_cma_migrate_fail(pfn, count, ret);
+		atomic_inc(&cma_stats.migrate_failures);
+		if (ret != -EBUSY) {
 			clear_cma_bitmap(cma, pfn, count);
 			pfn = 0;
 			break;
@@ -554,10 +667,69 @@ struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 		start = pageno + mask + 1;
 	}
 
+	usecs = ktime_us_delta(ktime_get(), begin);
+	cma_account_alloc(page != NULL, usecs);
+	trace_cma_alloc(page ? page_to_pfn(page) : 0, count, align, tries,
+			usecs);
+
+	/* Whatever was drained for this allocation is no longer needed */
+	if (cma->in_system) {
+		cancel_delayed_work(&cma->drain_timeout);
+		cma_drain_release(cma);
+	}
+
 	pr_debug("%s(): returned %p\n", __func__, page);
 	return page;
 }
 
+/**
+ * dma_contiguous_prepare() - drain contiguous area ahead of an allocation
+ * @dev:   Pointer to device which is about to allocate.
+ * @count: Number of pages it is going to request.
+ * @align: Requested alignment of pages (in PAGE_SIZE order).
+ *
+ * Migrating movable pages out of the CMA area is what makes
+ * dma_alloc_from_contiguous() slow.  A client which knows it is about
+ * to allocate (a camera being opened, say) can call this to have the
+ * range the allocation would try first drained from a workqueue.
+ * Until the allocation is made, or cma_drain_hold_ms have passed,
+ * movable allocations are kept off CMA pageblocks so the drained
+ * pages stay free.
+ */
+void dma_contiguous_prepare(struct device *dev, int count, unsigned int align)
+{
+	struct cma *cma = dev_get_cma_area(dev);
+	unsigned long mask, pageno;
+
+	if (!cma || !cma->count || !cma->in_system || count <= 0)
+		return;
+
+	if (align > CONFIG_CMA_ALIGNMENT)
+		align = CONFIG_CMA_ALIGNMENT;
+
+	mask = (1 << align) - 1;
+
+	mutex_lock(&cma->lock);
+	pageno = bitmap_find_next_zero_area(cma->bitmap, cma->count,
+					    0, count, mask);
+	if (pageno >= cma->count) {
+		mutex_unlock(&cma->lock);
+		return;
+	}
+	cma->drain_pfn = cma->base_pfn + pageno;
+	cma->drain_count = count;
+	if (!cma->drain_armed) {
+		cma->drain_armed = true;
+		cma_hold_movable(cma->base_pfn);
+	}
+	cancel_delayed_work(&cma->drain_timeout);
+	schedule_delayed_work(&cma->drain_timeout,
+			      msecs_to_jiffies(cma_drain_hold_ms));
+	mutex_unlock(&cma->lock);
+
+	schedule_work(&cma->drain_work);
+}
+
 /**
  * dma_release_from_contiguous() - release allocated pages
  * @dev:   Pointer to device for which the pages were allocated.
@@ -592,3 +764,55 @@ bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 
 	return true;
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int cma_stats_show(struct seq_file *m, void *unused)
+{
+	int i;
+
+	seq_printf(m, "allocs: %d\n", atomic_read(&cma_stats.allocs));
+	seq_printf(m, "failures: %d\n", atomic_read(&cma_stats.failures));
+	seq_printf(m, "migrate_failures: %d\n",
+		   atomic_read(&cma_stats.migrate_failures));
+	seq_printf(m, "drains: %d\n", atomic_read(&cma_stats.drains));
+	seq_printf(m, "drain_failures: %d\n",
+		   atomic_read(&cma_stats.drain_failures));
+
+	seq_printf(m, "latency:\n");
+	seq_printf(m, "%7s %7s: %d\n", "0", "1ms",
+		   atomic_read(&cma_stats.latency[0]));
+	for (i = 1; i < CMA_LATENCY_BUCKETS - 1; i++)
+		seq_printf(m, "%5lums %5lums: %d\n", 1UL << (i - 1), 1UL << i,
+			   atomic_read(&cma_stats.latency[i]));
+	seq_printf(m, "%5lums %7s: %d\n", 1UL << (i - 1), "-",
+		   atomic_read(&cma_stats.latency[i]));
+	return 0;
+}
+
+static int cma_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cma_stats_show, inode->i_private);
+}
+
+static const struct file_operations cma_stats_fops = {
+	.open		= cma_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init cma_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("cma", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	debugfs_create_file("stats", S_IRUGO, dir, NULL, &cma_stats_fops);
+	debugfs_create_u32("drain_hold_ms", S_IRUGO | S_IWUSR, dir,
+			   &cma_drain_hold_ms);
+	return 0;
+}
+late_initcall(cma_debugfs_init);
+#endif
@@ -1706,10 +1706,10 @@ static int debug_shrink_set(void *data, u64 val)
         if (!val)
                 return 0;
 
-        objs = heap->shrinker.shrink(&heap->shrinker, &sc);
+        objs = heap->shrinker.count_objects(&heap->shrinker, &sc);
         sc.nr_to_scan = objs;
 
-        heap->shrinker.shrink(&heap->shrinker, &sc);
+        heap->shrinker.scan_objects(&heap->shrinker, &sc);
         return 0;
 }
 
@@ -1722,7 +1722,7 @@ static int debug_shrink_get(void *data, u64 *val)
         sc.gfp_mask = -1;
         sc.nr_to_scan = 0;
 
-        objs = heap->shrinker.shrink(&heap->shrinker, &sc);
+        objs = heap->shrinker.count_objects(&heap->shrinker, &sc);
         *val = objs;
         return 0;
 }
@@ -1761,7 +1761,7 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 	}
 
 #ifdef DEBUG_HEAP_SHRINKER
-	if (heap->shrinker.shrink) {
+	if (heap->shrinker.count_objects && heap->shrinker.scan_objects) {
 		char debug_name[64];
 
 		snprintf(debug_name, 64, "%s_shrink", heap->name);
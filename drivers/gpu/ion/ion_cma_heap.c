@@ -21,6 +21,7 @@
 #include <linux/errno.h>
 #include <linux/err.h>
 #include <linux/dma-mapping.h>
+#include <linux/dma-contiguous.h>
 #include <linux/msm_ion.h>
 #include <linux/highmem.h>
 #include <mach/iommu_domains.h>
@@ -254,6 +255,21 @@ struct ion_heap *ion_cma_heap_create(struct ion_platform_heap *data)
 	return heap;
 }
 
+int ion_cma_prefetch(struct ion_heap *heap, void *data)
+{
+	unsigned long len = PAGE_ALIGN((unsigned long)data);
+
+	if ((int) heap->type != ION_HEAP_TYPE_DMA)
+		return -EINVAL;
+
+	if (len == 0)
+		return -EINVAL;
+
+	/* match the count and order the DMA mapping code will ask for */
+	dma_contiguous_prepare(heap->priv, len >> PAGE_SHIFT, get_order(len));
+	return 0;
+}
+
 void ion_cma_heap_destroy(struct ion_heap *heap)
 {
 	kfree(heap);
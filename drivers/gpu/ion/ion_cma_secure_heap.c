@@ -344,30 +344,37 @@ int ion_secure_cma_drain_pool(struct ion_heap *heap, void *unused)
 	return 0;
 }
 
-static int ion_secure_cma_shrinker(struct shrinker *shrinker,
-					struct shrink_control *sc)
+static unsigned long ion_secure_cma_shrink_count(struct shrinker *shrinker,
+						 struct shrink_control *sc)
 {
 	struct ion_cma_secure_heap *sheap = container_of(shrinker,
 					struct ion_cma_secure_heap, shrinker);
-	int nr_to_scan = sc->nr_to_scan;
-	struct list_head *entry, *_n;
-
-	if (nr_to_scan == 0)
-		return atomic_read(&sheap->total_pool_size);
 
 	/*
 	 * CMA pages can only be used for movable allocation so don't free if
 	 * the allocation isn't movable
 	 */
 	if (!(sc->gfp_mask & __GFP_MOVABLE))
-		return atomic_read(&sheap->total_pool_size);
+		return 0;
+
+	return atomic_read(&sheap->total_pool_size);
+}
+
+static unsigned long ion_secure_cma_shrink_scan(struct shrinker *shrinker,
+						struct shrink_control *sc)
+{
+	struct ion_cma_secure_heap *sheap = container_of(shrinker,
+					struct ion_cma_secure_heap, shrinker);
+	long nr_to_scan = sc->nr_to_scan;
+	unsigned long freed = 0;
+	struct list_head *entry, *_n;
 
 	/*
 	 * Allocation path may recursively call the shrinker. Don't shrink if
 	 * that happens.
 	 */
 	if (!mutex_trylock(&sheap->chunk_lock))
-		return -1;
+		return SHRINK_STOP;
 
 	list_for_each_safe(entry, _n, &sheap->chunks) {
 		struct ion_cma_alloc_chunk *chunk = container_of(entry,
@@ -378,12 +385,13 @@ static int ion_secure_cma_shrinker(struct shrinker *shrinker,
 
 		if (atomic_read(&chunk->cnt) == 0) {
 			nr_to_scan -= chunk->chunk_size;
+			freed += chunk->chunk_size;
 			ion_secure_cma_free_chunk(sheap, chunk);
 		}
 	}
 	mutex_unlock(&sheap->chunk_lock);
 
-	return atomic_read(&sheap->total_pool_size);
+	return freed;
 }
 
 static void ion_secure_cma_free_from_pool(struct ion_cma_secure_heap *sheap,
@@ -678,7 +686,8 @@ struct ion_heap *ion_secure_cma_heap_create(struct ion_platform_heap *data)
 	INIT_WORK(&sheap->work, ion_secure_pool_pages);
 	sheap->shrinker.seeks = DEFAULT_SEEKS;
 	sheap->shrinker.batch = 0;
-	sheap->shrinker.shrink = ion_secure_cma_shrinker;
+	sheap->shrinker.count_objects = ion_secure_cma_shrink_count;
+	sheap->shrinker.scan_objects = ion_secure_cma_shrink_scan;
 	sheap->default_prefetch_size = sheap->heap_size;
 	register_shrinker(&sheap->shrinker);
 
@@ -146,6 +146,7 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 	int nr_freed = 0;
 	int i;
 	bool high;
+	LIST_HEAD(pages);
 
 	high = gfp_mask & __GFP_HIGHMEM;
 
@@ -168,9 +169,14 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 			break;
 		}
 		mutex_unlock(&pool->mutex);
-		ion_page_pool_free_pages(pool, page);
+		/* order-0 pages go back to the page allocator in one batch */
+		if (pool->order)
+			ion_page_pool_free_pages(pool, page);
+		else
+			list_add(&page->lru, &pages);
 		nr_freed += (1 << pool->order);
 	}
+	free_page_list(&pages);
 
 	return nr_freed;
 }
@@ -97,8 +97,11 @@ static void free_buffer_page(struct ion_system_heap *heap,
 
 	if ((buffer->flags & ION_FLAG_FREED_FROM_SHRINKER)) {
 		if (split_pages) {
+			LIST_HEAD(pages);
+
 			for (i = 0; i < (1 << order); i++)
-				__free_page(page + i);
+				list_add(&page[i].lru, &pages);
+			free_page_list(&pages);
 		} else {
 			__free_pages(page, order);
 		}
@@ -365,20 +368,39 @@ static struct ion_heap_ops system_heap_ops = {
 	.map_user = ion_heap_map_user,
 };
 
-static int ion_system_heap_shrink(struct shrinker *shrinker,
-				  struct shrink_control *sc) {
-
+static unsigned long ion_system_heap_shrink_count(struct shrinker *shrinker,
+						  struct shrink_control *sc)
+{
 	struct ion_heap *heap = container_of(shrinker, struct ion_heap,
 					     shrinker);
 	struct ion_system_heap *sys_heap = container_of(heap,
 							struct ion_system_heap,
 							heap);
-	int nr_total = 0;
-	int nr_freed = 0;
+	unsigned long nr_total = 0;
 	int i;
 
-	if (sc->nr_to_scan == 0)
-		goto end;
+	/* total number of items is whatever the page pools are holding
+	   plus whatever's in the freelist */
+	for (i = 0; i < num_orders; i++) {
+		nr_total += ion_page_pool_shrink(
+			sys_heap->uncached_pools[i], sc->gfp_mask, 0);
+		nr_total += ion_page_pool_shrink(
+			sys_heap->cached_pools[i], sc->gfp_mask, 0);
+	}
+	nr_total += ion_heap_freelist_size(heap) / PAGE_SIZE;
+	return nr_total;
+}
+
+static unsigned long ion_system_heap_shrink_scan(struct shrinker *shrinker,
+						 struct shrink_control *sc)
+{
+	struct ion_heap *heap = container_of(shrinker, struct ion_heap,
+					     shrinker);
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	unsigned long nr_freed = 0;
+	int i;
 
 	/* shrink the free list first, no point in zeroing the memory if
 	   we're just going to reclaim it. Also, skip any possible
@@ -386,33 +408,17 @@ static int ion_system_heap_shrink(struct shrinker *shrinker,
 	nr_freed += ion_heap_freelist_drain_from_shrinker(
 		heap, sc->nr_to_scan * PAGE_SIZE) / PAGE_SIZE;
 
-	if (nr_freed >= sc->nr_to_scan)
-		goto end;
-
-	for (i = 0; i < num_orders; i++) {
+	for (i = 0; i < num_orders && nr_freed < sc->nr_to_scan; i++) {
 		nr_freed += ion_page_pool_shrink(sys_heap->uncached_pools[i],
 						sc->gfp_mask, sc->nr_to_scan);
 		if (nr_freed >= sc->nr_to_scan)
-			goto end;
+			break;
 
 		nr_freed += ion_page_pool_shrink(sys_heap->cached_pools[i],
 						sc->gfp_mask, sc->nr_to_scan);
-		if (nr_freed >= sc->nr_to_scan)
-			goto end;
-	}
-
-end:
-	/* total number of items is whatever the page pools are holding
-	   plus whatever's in the freelist */
-	for (i = 0; i < num_orders; i++) {
-		nr_total += ion_page_pool_shrink(
-			sys_heap->uncached_pools[i], sc->gfp_mask, 0);
-		nr_total += ion_page_pool_shrink(
-			sys_heap->cached_pools[i], sc->gfp_mask, 0);
 	}
-	nr_total += ion_heap_freelist_size(heap) / PAGE_SIZE;
-	return nr_total;
 
+	return nr_freed;
 }
 
 static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
@@ -512,7 +518,8 @@ struct ion_heap *ion_system_heap_create(struct ion_platform_heap *unused)
 	if (ion_system_heap_create_pools(heap->cached_pools))
 		goto err_create_cached_pools;
 
-	heap->heap.shrinker.shrink = ion_system_heap_shrink;
+	heap->heap.shrinker.count_objects = ion_system_heap_shrink_count;
+	heap->heap.shrinker.scan_objects = ion_system_heap_shrink_scan;
 	heap->heap.shrinker.seeks = DEFAULT_SEEKS;
 	heap->heap.shrinker.batch = 0;
 	register_shrinker(&heap->heap.shrinker);
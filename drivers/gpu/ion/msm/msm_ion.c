@@ -960,6 +960,17 @@ int ion_heap_allow_heap_secure(enum ion_heap_type type)
 	return type == ((enum ion_heap_type) ION_HEAP_TYPE_CP);
 }
 
+/*
+ * Secure CMA heaps prefetch into their pool; plain CMA heaps get the
+ * movable pages migrated out of the range the allocation will use.
+ */
+static int msm_ion_heap_prefetch(struct ion_heap *heap, void *data)
+{
+	if ((int) heap->type == ION_HEAP_TYPE_DMA)
+		return ion_cma_prefetch(heap, data);
+	return ion_secure_cma_prefetch(heap, data);
+}
+
 static long msm_ion_custom_ioctl(struct ion_client *client,
 				unsigned int cmd,
 				unsigned long arg)
@@ -1075,7 +1086,7 @@ static long msm_ion_custom_ioctl(struct ion_client *client,
 			return -EFAULT;
 
 		ion_walk_heaps(client, data.heap_id, (void *)data.len,
-						ion_secure_cma_prefetch);
+						msm_ion_heap_prefetch);
 		break;
 	}
 	case ION_IOC_DRAIN:
@@ -53,6 +53,8 @@ void ion_cp_heap_destroy(struct ion_heap *);
 struct ion_heap *ion_cma_heap_create(struct ion_platform_heap *);
 void ion_cma_heap_destroy(struct ion_heap *);
 
+int ion_cma_prefetch(struct ion_heap *heap, void *data);
+
 struct ion_heap *ion_secure_cma_heap_create(struct ion_platform_heap *);
 void ion_secure_cma_heap_destroy(struct ion_heap *);
 
@@ -61,6 +63,11 @@ int ion_secure_cma_prefetch(struct ion_heap *heap, void *data);
 int ion_secure_cma_drain_pool(struct ion_heap *heap, void *unused);
 
 #else
+static inline int ion_cma_prefetch(struct ion_heap *heap, void *data)
+{
+	return -ENODEV;
+}
+
 static inline int ion_secure_cma_prefetch(struct ion_heap *heap, void *data)
 {
 	return -ENODEV;
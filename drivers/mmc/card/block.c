@@ -33,6 +33,7 @@
 #include <linux/bitops.h>
 #include <linux/string_helpers.h>
 #include <linux/delay.h>
+#include <linux/hrtimer.h>
 #include <linux/capability.h>
 #include <linux/compat.h>
 #include <linux/pm_runtime.h>
@@ -96,6 +97,10 @@ static int cprm_ake_retry_flag;
 #define PCKD_TRGR_LOWER_BOUND		5
 #define PCKD_TRGR_PRECISION_MULTIPLIER	100
 
+/* packed commands to issue without waiting after a fruitless wait */
+#define MMC_BLK_WR_PACK_HOLD_BACKOFF	8
+#define MMC_BLK_WR_PACK_HOLD_SLACK_NS	(50 * NSEC_PER_USEC)
+
 static DEFINE_MUTEX(block_mutex);
 
 /*
@@ -148,6 +153,7 @@ struct mmc_blk_data {
 	struct device_attribute num_wr_reqs_to_start_packing;
 	struct device_attribute bkops_check_threshold;
 	struct device_attribute no_pack_for_random;
+	struct device_attribute wr_pack_hold_us;
 	int	area_type;
 };
 
@@ -500,6 +506,60 @@ exit:
 	return ret;
 }
 
+static ssize_t
+wr_pack_hold_us_show(struct device *dev,
+		     struct device_attribute *attr, char *buf)
+{
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	int ret;
+
+	if (!md)
+		return -EINVAL;
+	ret = snprintf(buf, PAGE_SIZE, "%u\n", md->queue.wr_pack_hold_us);
+
+	mmc_blk_put(md);
+	return ret;
+}
+
+static ssize_t
+wr_pack_hold_us_store(struct device *dev,
+		      struct device_attribute *attr,
+		      const char *buf, size_t count)
+{
+	unsigned int value;
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	struct mmc_card *card;
+	int ret = count;
+
+	if (!md)
+		return -EINVAL;
+
+	card = md->queue.card;
+	if (!card) {
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	if (kstrtouint(buf, 0, &value) || value > USEC_PER_MSEC * 10) {
+		pr_err("%s: wr_pack_hold_us must be 0..%lu, old value remains = %u",
+			mmc_hostname(card->host), USEC_PER_MSEC * 10,
+			md->queue.wr_pack_hold_us);
+		ret = -EINVAL;
+		goto exit;
+	}
+
+	md->queue.wr_pack_hold_us = value;
+	md->queue.wr_pack_hold_skip = 0;
+
+	pr_debug("%s: wr_pack_hold_us: new value = %u",
+		mmc_hostname(card->host),
+		md->queue.wr_pack_hold_us);
+
+exit:
+	mmc_blk_put(md);
+	return ret;
+}
+
 static int mmc_blk_open(struct block_device *bdev, fmode_t mode)
 {
 	struct mmc_blk_data *md = mmc_blk_get(bdev->bd_disk);
@@ -2259,11 +2319,46 @@ void mmc_blk_init_packed_statistics(struct mmc_card *card)
 	       sizeof(*card->wr_pack_stats.packing_events));
 	memset(&card->wr_pack_stats.pack_stop_reason, 0,
 		sizeof(card->wr_pack_stats.pack_stop_reason));
+	card->wr_pack_stats.hold_events = 0;
+	card->wr_pack_stats.hold_fruitless = 0;
+	card->wr_pack_stats.hold_reqs = 0;
+	card->wr_pack_stats.hold_cut = 0;
 	card->wr_pack_stats.enabled = true;
 	spin_unlock(&card->wr_pack_stats.lock);
 }
 EXPORT_SYMBOL(mmc_blk_init_packed_statistics);
 
+/*
+ * Wait until @end for another request to be queued behind a packed write
+ * list; mmc_request() and mmc_urgent_request() wake us up early.  Returns
+ * false once the window has closed or packing got disabled, in which case
+ * the caller should issue what it has collected so far.
+ */
+static bool mmc_blk_wr_pack_hold(struct mmc_queue *mq, ktime_t end)
+{
+	struct request_queue *q = mq->queue;
+
+	if (!mq->wr_packing_enabled)
+		return false;
+
+	if (ktime_to_ns(ktime_sub(end, ktime_get())) <= 0)
+		return false;
+
+	spin_lock_irq(q->queue_lock);
+	if (!blk_peek_request(q)) {
+		mq->wr_pack_holding = true;
+		set_current_state(TASK_INTERRUPTIBLE);
+		spin_unlock_irq(q->queue_lock);
+		schedule_hrtimeout_range(&end, MMC_BLK_WR_PACK_HOLD_SLACK_NS,
+					 HRTIMER_MODE_ABS);
+		spin_lock_irq(q->queue_lock);
+		mq->wr_pack_holding = false;
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	return true;
+}
+
 static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
 {
 	struct request_queue *q = mq->queue;
@@ -2276,6 +2371,9 @@ static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
 	u8 put_back = 0;
 	u8 max_packed_rw = 0;
 	u8 reqs = 0;
+	u8 held_at = 0;
+	bool can_hold, held = false, hold_cut = false;
+	ktime_t hold_end;
 	struct mmc_wr_pack_stats *stats = &card->wr_pack_stats;
 
 	mmc_blk_clear_packed(mq->mqrq_cur);
@@ -2320,12 +2418,37 @@ static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
 		phys_segments++;
 	}
 
+	/*
+	 * While packing is enabled the write stream is dense enough that
+	 * waiting briefly for the queue to refill usually buys a larger
+	 * packed command.  Back off for a while when a wait gains nothing.
+	 */
+	if (mq->wr_pack_hold_skip) {
+		mq->wr_pack_hold_skip--;
+		can_hold = false;
+	} else {
+		can_hold = mq->wr_pack_hold_us != 0;
+	}
+	hold_end = ktime_add_us(ktime_get(), mq->wr_pack_hold_us);
+
 	spin_lock(&stats->lock);
 
 	while (reqs < max_packed_rw - 1) {
 		spin_lock_irq(q->queue_lock);
 		next = blk_fetch_request(q);
 		spin_unlock_irq(q->queue_lock);
+		if (!next && can_hold) {
+			spin_unlock(&stats->lock);
+			can_hold = mmc_blk_wr_pack_hold(mq, hold_end);
+			spin_lock(&stats->lock);
+			if (can_hold) {
+				if (!held) {
+					held = true;
+					held_at = reqs;
+				}
+				continue;
+			}
+		}
 		if (!next) {
 			MMC_BLK_UPDATE_STOP_REASON(stats, EMPTY_QUEUE);
 			break;
@@ -2400,6 +2523,27 @@ static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
 		reqs++;
 	}
 
+	if (held) {
+		/* reads, flushes and FUA writes must not wait behind the pack */
+		if (!mq->wr_packing_enabled)
+			hold_cut = true;
+		else if (put_back && (rq_data_dir(next) == READ ||
+			 (next->cmd_flags & (REQ_FLUSH | REQ_DISCARD | REQ_FUA))))
+			hold_cut = true;
+
+		if (reqs == held_at)
+			mq->wr_pack_hold_skip = MMC_BLK_WR_PACK_HOLD_BACKOFF;
+
+		if (stats->enabled) {
+			stats->hold_events++;
+			stats->hold_reqs += reqs - held_at;
+			if (reqs == held_at)
+				stats->hold_fruitless++;
+			if (hold_cut)
+				stats->hold_cut++;
+		}
+	}
+
 	if (put_back) {
 		spin_lock_irq(q->queue_lock);
 		blk_requeue_request(q, next);
@@ -3134,6 +3278,8 @@ static void mmc_blk_remove_req(struct mmc_blk_data *md)
 		card = md->queue.card;
 		device_remove_file(disk_to_dev(md->disk),
 				   &md->num_wr_reqs_to_start_packing);
+		device_remove_file(disk_to_dev(md->disk),
+				   &md->wr_pack_hold_us);
 		if (md->disk->flags & GENHD_FL_UP) {
 			device_remove_file(disk_to_dev(md->disk), &md->force_ro);
 			if ((md->area_type & MMC_BLK_DATA_AREA_BOOT) &&
@@ -3234,8 +3380,21 @@ static int mmc_add_disk(struct mmc_blk_data *md)
 	if (ret)
 		goto no_pack_for_random_fails;
 
+	md->wr_pack_hold_us.show = wr_pack_hold_us_show;
+	md->wr_pack_hold_us.store = wr_pack_hold_us_store;
+	sysfs_attr_init(&md->wr_pack_hold_us.attr);
+	md->wr_pack_hold_us.attr.name = "wr_pack_hold_us";
+	md->wr_pack_hold_us.attr.mode = S_IRUGO | S_IWUSR;
+	ret = device_create_file(disk_to_dev(md->disk),
+				 &md->wr_pack_hold_us);
+	if (ret)
+		goto wr_pack_hold_us_fails;
+
 	return ret;
 
+wr_pack_hold_us_fails:
+	device_remove_file(disk_to_dev(md->disk),
+			   &md->no_pack_for_random);
 no_pack_for_random_fails:
 	device_remove_file(disk_to_dev(md->disk),
 			   &md->bkops_check_threshold);
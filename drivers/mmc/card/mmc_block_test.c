@@ -60,6 +60,8 @@
 #define LONG_TEST_SIZE_FRACTION(x) (BYTE_TO_MB_x_10(x) - \
 		(LONG_TEST_SIZE_INTEGER(x) * 10))
 #define LONG_WRITE_TEST_SLEEP_TIME_MS 5
+/* how long the packer may wait for more writes in the hold testcase */
+#define TEST_WR_PACK_HOLD_US		1000
 
 #define test_pr_debug(fmt, args...) pr_debug("%s: "fmt"\n", MODULE_NAME, args)
 #define test_pr_info(fmt, args...) pr_info("%s: "fmt"\n", MODULE_NAME, args)
@@ -91,7 +93,9 @@ enum mmc_block_test_testcases {
 	TEST_STOP_DUE_TO_EMPTY_QUEUE,
 	TEST_STOP_DUE_TO_MAX_REQ_NUM,
 	TEST_STOP_DUE_TO_THRESHOLD,
-	SEND_WRITE_PACKING_MAX_TESTCASE = TEST_STOP_DUE_TO_THRESHOLD,
+	TEST_STOP_DUE_TO_EMPTY_QUEUE_AFTER_HOLD,
+	SEND_WRITE_PACKING_MAX_TESTCASE =
+				TEST_STOP_DUE_TO_EMPTY_QUEUE_AFTER_HOLD,
 
 	/* Start of err check test group */
 	ERR_CHECK_MIN_TESTCASE,
@@ -225,6 +229,9 @@ struct mmc_block_test_data {
 	wait_queue_head_t bkops_wait_q;
 	/* A counter for the number of test requests completed */
 	unsigned int completed_req_count;
+	/* The queue's write packing hold time, restored after each test */
+	unsigned int saved_wr_pack_hold_us;
+	bool wr_pack_hold_saved;
 };
 
 static struct mmc_block_test_data *mbtd;
@@ -577,6 +584,8 @@ switch (td->test_info.testcase) {
 		return "\"stop due to max req num\"";
 	case TEST_STOP_DUE_TO_THRESHOLD:
 		return "\"stop due to exceeding threshold\"";
+	case TEST_STOP_DUE_TO_EMPTY_QUEUE_AFTER_HOLD:
+		return "\"stop due to empty queue after waiting for writes\"";
 	case TEST_RET_ABORT:
 		return "\"err_check return abort\"";
 	case TEST_RET_PARTIAL_FOLLOWED_BY_SUCCESS:
@@ -798,6 +807,28 @@ static int check_wr_packing_statistics(struct test_data *td)
 		goto exit_err;
 	}
 
+	if (mmc_packed_stats->hold_events != expected_stats.hold_events) {
+		test_pr_err("%s: Wrong number of hold events %d, expected %d",
+			__func__, mmc_packed_stats->hold_events,
+			expected_stats.hold_events);
+		if (td->fs_wr_reqs_during_test)
+			goto cancel_round;
+		ret = -EINVAL;
+		goto exit_err;
+	}
+
+	if (mmc_packed_stats->hold_fruitless !=
+	    expected_stats.hold_fruitless) {
+		test_pr_err(
+		"%s: Wrong number of fruitless hold events %d, expected %d",
+			__func__, mmc_packed_stats->hold_fruitless,
+			expected_stats.hold_fruitless);
+		if (td->fs_wr_reqs_during_test)
+			goto cancel_round;
+		ret = -EINVAL;
+		goto exit_err;
+	}
+
 exit_err:
 	spin_unlock(&mmc_packed_stats->lock);
 	if (ret && mmc_packed_stats->enabled)
@@ -994,6 +1025,8 @@ static int prepare_packed_requests(struct test_data *td, int is_err_expected,
 		sizeof(mbtd->exp_packed_stats.pack_stop_reason));
 	memset(mbtd->exp_packed_stats.packing_events, 0,
 		(max_packed_reqs + 1) * sizeof(u32));
+	mbtd->exp_packed_stats.hold_events = 0;
+	mbtd->exp_packed_stats.hold_fruitless = 0;
 	if (num_requests <= max_packed_reqs)
 		mbtd->exp_packed_stats.packing_events[num_requests] = 1;
 
@@ -1024,6 +1057,12 @@ static int prepare_packed_requests(struct test_data *td, int is_err_expected,
 	case TEST_RET_PARTIAL_MAX_FAIL_IDX:
 		mbtd->exp_packed_stats.pack_stop_reason[THRESHOLD] = 1;
 		break;
+	case TEST_STOP_DUE_TO_EMPTY_QUEUE_AFTER_HOLD:
+		/* nothing else is queued, so the single wait gains nothing */
+		mbtd->exp_packed_stats.pack_stop_reason[EMPTY_QUEUE] = 1;
+		mbtd->exp_packed_stats.hold_events = 1;
+		mbtd->exp_packed_stats.hold_fruitless = 1;
+		break;
 	default:
 		mbtd->exp_packed_stats.pack_stop_reason[EMPTY_QUEUE] = 1;
 	}
@@ -1104,6 +1143,8 @@ static int prepare_packed_control_tests_requests(struct test_data *td,
 		sizeof(mbtd->exp_packed_stats.pack_stop_reason));
 	memset(mbtd->exp_packed_stats.packing_events, 0,
 		(max_packed_reqs + 1) * sizeof(u32));
+	mbtd->exp_packed_stats.hold_events = 0;
+	mbtd->exp_packed_stats.hold_fruitless = 0;
 
 	switch (td->test_info.testcase) {
 	case TEST_PACKING_EXP_N_OVER_TRIGGER_FB_READ:
@@ -1250,6 +1291,8 @@ static int prepare_partial_followed_by_abort(struct test_data *td,
 		sizeof(mbtd->exp_packed_stats.pack_stop_reason));
 	memset(mbtd->exp_packed_stats.packing_events, 0,
 		(max_packed_reqs + 1) * sizeof(u32));
+	mbtd->exp_packed_stats.hold_events = 0;
+	mbtd->exp_packed_stats.hold_fruitless = 0;
 	mbtd->exp_packed_stats.packing_events[num_requests] = 1;
 	mbtd->exp_packed_stats.pack_stop_reason[EMPTY_QUEUE] = 1;
 
@@ -1418,6 +1461,7 @@ static int prepare_test(struct test_data *td)
 	case TEST_RET_PARTIAL_FOLLOWED_BY_SUCCESS:
 	case TEST_RET_PARTIAL_MULTIPLE_UNTIL_SUCCESS:
 	case TEST_STOP_DUE_TO_EMPTY_QUEUE:
+	case TEST_STOP_DUE_TO_EMPTY_QUEUE_AFTER_HOLD:
 	case TEST_CMD23_PACKED_BIT_UNSET:
 		ret = prepare_packed_requests(td, 0, num_requests, is_random);
 		break;
@@ -1519,6 +1563,21 @@ static int run_packed_test(struct test_data *td)
 	}
 	mmc_blk_init_packed_statistics(mq->card);
 
+	/*
+	 * All the test requests are queued before the run, so the packer
+	 * would only ever wait on an empty queue. Keep the statistics of the
+	 * other testcases deterministic by not waiting at all there.
+	 */
+	if (!mbtd->wr_pack_hold_saved) {
+		mbtd->saved_wr_pack_hold_us = mq->wr_pack_hold_us;
+		mbtd->wr_pack_hold_saved = true;
+	}
+	if (td->test_info.testcase == TEST_STOP_DUE_TO_EMPTY_QUEUE_AFTER_HOLD)
+		mq->wr_pack_hold_us = TEST_WR_PACK_HOLD_US;
+	else
+		mq->wr_pack_hold_us = 0;
+	mq->wr_pack_hold_skip = 0;
+
 	if (td->test_info.testcase != TEST_PACK_MIX_PACKED_NO_PACKED_PACKED) {
 		/*
 		 * Verify that the packing is disabled before starting the
@@ -1556,6 +1615,11 @@ static int post_test(struct test_data *td)
 	mq->packed_test_fn = NULL;
 	mq->err_check_fn = NULL;
 
+	if (mbtd->wr_pack_hold_saved) {
+		mq->wr_pack_hold_us = mbtd->saved_wr_pack_hold_us;
+		mbtd->wr_pack_hold_saved = false;
+	}
+
 	return 0;
 }
 
@@ -2301,7 +2365,8 @@ static ssize_t send_write_packing_test_read(struct file *file,
 		 "- Pack due to READ after threshold writes\n"
 		 "- Pack due to empty queue\n"
 		 "- Pack due to threshold writes\n"
-		 "- Pack due to one over threshold writes\n");
+		 "- Pack due to one over threshold writes\n"
+		 "- Pack due to empty queue after waiting for writes\n");
 
 	if (message_repeat == 1) {
 		message_repeat = 0;
@@ -2570,6 +2635,7 @@ static ssize_t write_packing_control_test_write(struct file *file,
 	mbtd->test_info.run_test_fn = run_packed_test;
 	mbtd->test_info.check_test_result_fn = check_wr_packing_statistics;
 	mbtd->test_info.get_test_case_str_fn = get_test_case_str;
+	mbtd->test_info.post_test_fn = post_test;
 
 	for (i = 0; i < number; ++i) {
 		test_pr_info("%s: Cycle # %d / %d", __func__, i+1, number);
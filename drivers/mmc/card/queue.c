@@ -31,6 +31,14 @@
  */
 #define DEFAULT_NUM_REQS_TO_START_PACK 17
 
+/*
+ * Once write packing is enabled, the packer may wait this long for more
+ * writes to arrive before issuing a packed command that is not yet full.
+ * The card is normally still busy with the previous request at that point,
+ * so the wait mostly overlaps with transfer time.
+ */
+#define DEFAULT_WR_PACK_HOLD_US 250
+
 /*
  * Prepare a MMC request. This just filters out odd stuff.
  */
@@ -139,6 +147,12 @@ static void mmc_request(struct request_queue *q)
 		return;
 	}
 
+	/* The packer is waiting for more writes, let it look at this one */
+	if (mq->wr_pack_holding) {
+		wake_up_process(mq->thread);
+		return;
+	}
+
 	cntx = &mq->card->host->context_info;
 	if (!mq->mqrq_cur->req && mq->mqrq_prev->req) {
 		/*
@@ -190,6 +204,8 @@ static void mmc_urgent_request(struct request_queue *q)
 		mmc_blk_disable_wr_packing(mq);
 		cntx->is_urgent = true;
 		spin_unlock_irqrestore(&cntx->lock, flags);
+		if (mq->wr_pack_holding)
+			wake_up_process(mq->thread);
 		wake_up_interruptible(&cntx->wait);
 	} else {
 		spin_unlock_irqrestore(&cntx->lock, flags);
@@ -281,6 +297,7 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 	mq->num_wr_reqs_to_start_packing =
 		min_t(int, (int)card->ext_csd.max_packed_writes,
 		     DEFAULT_NUM_REQS_TO_START_PACK);
+	mq->wr_pack_hold_us = DEFAULT_WR_PACK_HOLD_US;
 
 	blk_queue_prep_rq(mq->queue, mmc_prep_request);
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
@@ -53,6 +53,9 @@ struct mmc_queue {
 	int			num_of_potential_packed_wr_reqs;
 	int			num_wr_reqs_to_start_packing;
 	bool			no_pack_for_random;
+	unsigned int		wr_pack_hold_us;
+	int			wr_pack_hold_skip;
+	bool			wr_pack_holding;
 	int (*err_check_fn) (struct mmc_card *, struct mmc_async_req *);
 	void (*packed_test_fn) (struct request_queue *, struct mmc_queue_req *);
 };
@@ -388,6 +388,7 @@ static ssize_t mmc_wr_pack_stats_read(struct file *filp, char __user *ubuf,
 	struct mmc_wr_pack_stats *pack_stats;
 	int i;
 	int max_num_of_packed_reqs = 0;
+	unsigned int total_packs = 0, total_reqs = 0;
 	char *temp_buf;
 
 	if (!card)
@@ -431,6 +432,10 @@ static ssize_t mmc_wr_pack_stats_read(struct file *filp, char __user *ubuf,
 				mmc_hostname(card->host), i,
 				pack_stats->packing_events[i]);
 			strlcat(ubuf, temp_buf, cnt);
+			if (i > 1) {
+				total_packs += pack_stats->packing_events[i];
+				total_reqs += i * pack_stats->packing_events[i];
+			}
 		}
 	}
 
@@ -511,6 +516,25 @@ static ssize_t mmc_wr_pack_stats_read(struct file *filp, char __user *ubuf,
 		strlcat(ubuf, temp_buf, cnt);
 	}
 
+	if (total_packs) {
+		snprintf(temp_buf, TEMP_BUF_SIZE,
+			 "%s: %u reqs in %u packed cmds, %u.%02u reqs per cmd\n",
+			mmc_hostname(card->host), total_reqs, total_packs,
+			total_reqs / total_packs,
+			(total_reqs % total_packs) * 100 / total_packs);
+		strlcat(ubuf, temp_buf, cnt);
+	}
+
+	if (pack_stats->hold_events) {
+		snprintf(temp_buf, TEMP_BUF_SIZE,
+			 "%s: %d times: waited for more writes "
+			 "(%d fruitless, %d cut short, %d reqs gained)\n",
+			mmc_hostname(card->host),
+			pack_stats->hold_events, pack_stats->hold_fruitless,
+			pack_stats->hold_cut, pack_stats->hold_reqs);
+		strlcat(ubuf, temp_buf, cnt);
+	}
+
 	spin_unlock(&pack_stats->lock);
 
 	kfree(temp_buf);
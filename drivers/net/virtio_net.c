@@ -26,6 +26,7 @@
 #include <linux/scatterlist.h>
 #include <linux/if_vlan.h>
 #include <linux/slab.h>
+#include <net/busy_poll.h>
 
 static int napi_weight = 128;
 module_param(napi_weight, int, 0444);
@@ -345,6 +346,8 @@ static void receive_buf(struct net_device *dev, void *buf, unsigned int len)
 		skb_shinfo(skb)->gso_segs = 0;
 	}
 
+	skb_mark_napi_id(skb, &vi->napi);
+
 	netif_receive_skb(skb);
 	return;
 
@@ -618,6 +618,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	struct vm_struct tmp_area;
 	struct page **page;
 	struct mm_struct *mm;
+	LIST_HEAD(pages_to_free);
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: %s pages %pK-%pK\n", proc->pid,
@@ -703,11 +704,12 @@ free_range:
 err_vm_insert_page_failed:
 		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
 err_map_kernel_failed:
-		__free_page(*page);
+		list_add(&(*page)->lru, &pages_to_free);
 		*page = NULL;
 err_alloc_page_failed:
 		;
 	}
+	free_page_list(&pages_to_free);
 err_no_vma:
 	if (mm) {
 		up_write(&mm->mmap_sem);
@@ -3156,6 +3158,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 
 	page_count = 0;
 	if (proc->pages) {
+		LIST_HEAD(pages_to_free);
 		int i;
 		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
 			if (proc->pages[i]) {
@@ -3167,10 +3170,11 @@ static void binder_deferred_release(struct binder_proc *proc)
 					     page_addr);
 				unmap_kernel_range((unsigned long)page_addr,
 					PAGE_SIZE);
-				__free_page(proc->pages[i]);
+				list_add(&proc->pages[i]->lru, &pages_to_free);
 				page_count++;
 			}
 		}
+		free_page_list(&pages_to_free);
 		kfree(proc->pages);
 		vfree(proc->buffer);
 	}
@@ -148,11 +148,20 @@ extern atomic_t zswap_pool_pages;
 extern atomic_t zswap_stored_pages;
 #endif
 
-static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+static unsigned long lowmem_count(struct shrinker *s,
+				  struct shrink_control *sc)
+{
+	return global_page_state(NR_ACTIVE_ANON) +
+		global_page_state(NR_ACTIVE_FILE) +
+		global_page_state(NR_INACTIVE_ANON) +
+		global_page_state(NR_INACTIVE_FILE);
+}
+
+static unsigned long lowmem_scan(struct shrinker *s, struct shrink_control *sc)
 {
 	struct task_struct *tsk;
 	struct task_struct *selected = NULL;
-	int rem = 0;
+	unsigned long rem = 0;
 	int tasksize;
 	int i;
 	int min_score_adj = OOM_SCORE_ADJ_MAX + 1;
@@ -178,10 +187,8 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	bool flag = 0;
 #endif
 
-	if (nr_to_scan > 0) {
-		if (mutex_lock_interruptible(&scan_mutex) < 0)
-			return 0;
-	}
+	if (mutex_lock_interruptible(&scan_mutex) < 0)
+		return SHRINK_STOP;
 
 	other_free = global_page_state(NR_FREE_PAGES);
 
@@ -224,22 +231,14 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			break;
 		}
 	}
-	if (nr_to_scan > 0)
-		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d\n",
-				nr_to_scan, sc->gfp_mask, other_free,
-				other_file, min_score_adj);
-	rem = global_page_state(NR_ACTIVE_ANON) +
-		global_page_state(NR_ACTIVE_FILE) +
-		global_page_state(NR_INACTIVE_ANON) +
-		global_page_state(NR_INACTIVE_FILE);
-	if (nr_to_scan <= 0 || min_score_adj == OOM_SCORE_ADJ_MAX + 1) {
-		lowmem_print(5, "lowmem_shrink %lu, %x, return %d\n",
-			     nr_to_scan, sc->gfp_mask, rem);
-
-		if (nr_to_scan > 0)
-			mutex_unlock(&scan_mutex);
-
-		return rem;
+	lowmem_print(3, "lowmem_scan %lu, %x, ofree %d %d, ma %d\n",
+			nr_to_scan, sc->gfp_mask, other_free,
+			other_file, min_score_adj);
+	if (min_score_adj == OOM_SCORE_ADJ_MAX + 1) {
+		lowmem_print(5, "lowmem_scan %lu, %x, return 0\n",
+			     nr_to_scan, sc->gfp_mask);
+		mutex_unlock(&scan_mutex);
+		return 0;
 	}
 	selected_oom_score_adj = min_score_adj;
 
@@ -264,7 +263,7 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 				/* give the system time to free up the memory */
 				msleep_interruptible(20);
 				mutex_unlock(&scan_mutex);
-				return 0;
+				return SHRINK_STOP;
 			}
 		}
 
@@ -368,7 +367,7 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		lowmem_deathpending_timeout = jiffies + HZ;
 		send_sig(SIGKILL, selected, 0);
 		set_tsk_thread_flag(selected, TIF_MEMDIE);
-		rem -= selected_tasksize;
+		rem += selected_tasksize;
 		rcu_read_unlock();
 #ifdef LMK_COUNT_READ
                 lmk_count++;
@@ -376,7 +375,7 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 
 #ifdef CONFIG_SEC_DEBUG_LMK_MEMINFO
 		if ((selected_oom_score_adj < lowmem_adj[5]) && __ratelimit(&lmk_rs)) {
-			lowmem_print(1, "lowmem_shrink %lu, %x, ofree %d %d, ma %d\n",
+			lowmem_print(1, "lowmem_scan %lu, %x, ofree %d %d, ma %d\n",
 					nr_to_scan, sc->gfp_mask, other_free,
 					other_file, min_score_adj);
 			show_mem(SHOW_MEM_FILTER_NODES);
@@ -390,7 +389,7 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	} else
 		rcu_read_unlock();
 
-	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
+	lowmem_print(4, "lowmem_scan %lu, %x, return %lu\n",
 		     nr_to_scan, sc->gfp_mask, rem);
 	mutex_unlock(&scan_mutex);
 	return rem;
@@ -607,7 +606,8 @@ static struct notifier_block android_oom_notifier = {
 #endif /* CONFIG_SEC_OOM_KILLER */
 
 static struct shrinker lowmem_shrinker = {
-	.shrink = lowmem_shrink,
+	.count_objects = lowmem_count,
+	.scan_objects = lowmem_scan,
 	.seeks = DEFAULT_SEEKS * 16
 };
 
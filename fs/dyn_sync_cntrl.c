@@ -14,6 +14,12 @@
 #include <linux/notifier.h>
 #include <linux/reboot.h>
 #include <linux/writeback.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/completion.h>
+#include <linux/delay.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
 #include <linux/dyn_sync_cntrl.h>
 #include <linux/lcd_notify.h>
 
@@ -25,12 +31,174 @@ static DEFINE_MUTEX(fsync_mutex);
 
 bool suspend_active __read_mostly = false;
 bool dyn_fsync_active __read_mostly = DYN_FSYNC_ACTIVE_DEFAULT;
+unsigned int dyn_fsync_group_commit_us __read_mostly =
+	DYN_FSYNC_GROUP_COMMIT_US_DEFAULT;
 
 static struct notifier_block lcd_notif;
 
 extern void sync_filesystems(int wait);
 
 
+// Group commit
+//
+// Instead of dropping fsync() while the screen is on, concurrent fsync()
+// callers on the same filesystem are merged into one durable commit.  Every
+// caller writes back its own range first, then joins the open group for its
+// superblock.  The first caller becomes the leader, waits up to
+// dyn_fsync_group_commit_us for others to join (only when fsyncs have
+// recently overlapped), and then commits the whole group with a single
+// ->sync_fs(sb, 1) and cache flush.  A leader that ends up alone just runs
+// the file's own ->fsync, so an idle system sees no extra latency.
+// Filesystems opt in with FS_GROUP_FSYNC only where ->sync_fs is a journal
+// commit; f2fs does not, its ->sync_fs is a full checkpoint.
+
+#define FSYNC_GROUP_HASH_BITS	3
+#define FSYNC_GROUP_SLOTS	(1 << FSYNC_GROUP_HASH_BITS)
+
+struct fsync_group {
+	struct super_block *sb;
+	struct completion done;
+	atomic_t count;
+	int members;		/* followers, protected by slot->lock */
+	int err;
+};
+
+struct fsync_group_slot {
+	spinlock_t lock;
+	struct fsync_group *open;	/* group still accepting members */
+	int leaders;			/* groups being formed or committed */
+	bool batched;			/* last group had followers */
+};
+
+static struct fsync_group_slot fsync_group_slots[FSYNC_GROUP_SLOTS];
+
+static void fsync_group_put(struct fsync_group *group)
+{
+	if (atomic_dec_and_test(&group->count))
+		kfree(group);
+}
+
+static bool fsync_group_eligible(struct file *file)
+{
+	struct inode *inode = file->f_mapping->host;
+	struct super_block *sb = inode->i_sb;
+
+	return S_ISREG(inode->i_mode) && sb->s_bdev && sb->s_op->sync_fs &&
+		(sb->s_type->fs_flags & FS_GROUP_FSYNC) &&
+		!(sb->s_flags & MS_RDONLY);
+}
+
+static int fsync_group_commit(struct super_block *sb)
+{
+	int err;
+
+	err = sb->s_op->sync_fs(sb, 1);
+	if (!err) {
+		err = blkdev_issue_flush(sb->s_bdev, GFP_KERNEL, NULL);
+		if (err == -EOPNOTSUPP)
+			err = 0;
+	}
+	return err;
+}
+
+int dyn_fsync_group_commit(struct file *file, loff_t start, loff_t end,
+		int datasync)
+{
+	struct inode *inode = file->f_mapping->host;
+	struct super_block *sb = inode->i_sb;
+	struct fsync_group_slot *slot;
+	struct fsync_group *group;
+	unsigned int window = ACCESS_ONCE(dyn_fsync_group_commit_us);
+	bool wait;
+	int members;
+	int err;
+
+	if (!window || !fsync_group_eligible(file))
+		goto direct;
+
+	/*
+	 * The group commit only covers what has reached the filesystem, so
+	 * push this file's pages and inode out before joining.
+	 */
+	err = filemap_write_and_wait_range(file->f_mapping, start, end);
+	if (err)
+		return err;
+	err = sync_inode_metadata(inode, 0);
+	if (err)
+		return err;
+
+	slot = &fsync_group_slots[hash_ptr(sb, FSYNC_GROUP_HASH_BITS)];
+
+	spin_lock(&slot->lock);
+	group = slot->open;
+	if (group) {
+		if (group->sb != sb) {
+			/* slot busy with another filesystem */
+			spin_unlock(&slot->lock);
+			goto direct;
+		}
+		group->members++;
+		atomic_inc(&group->count);
+		spin_unlock(&slot->lock);
+
+		wait_for_completion(&group->done);
+		err = group->err;
+		fsync_group_put(group);
+		return err;
+	}
+	spin_unlock(&slot->lock);
+
+	group = kmalloc(sizeof(*group), GFP_KERNEL);
+	if (!group)
+		goto direct;
+	group->sb = sb;
+	init_completion(&group->done);
+	atomic_set(&group->count, 1);
+	group->members = 0;
+	group->err = 0;
+
+	spin_lock(&slot->lock);
+	if (slot->open) {
+		/* lost the race to lead, start over as a follower */
+		spin_unlock(&slot->lock);
+		kfree(group);
+		return dyn_fsync_group_commit(file, start, end, datasync);
+	}
+	slot->open = group;
+	wait = slot->leaders || slot->batched;
+	slot->leaders++;
+	spin_unlock(&slot->lock);
+
+	if (wait)
+		usleep_range(window, window + window / 2);
+
+	spin_lock(&slot->lock);
+	slot->open = NULL;
+	members = group->members;
+	slot->batched = members > 0;
+	spin_unlock(&slot->lock);
+
+	if (members)
+		err = fsync_group_commit(sb);
+	else
+		err = file->f_op->fsync(file, start, end, datasync);
+
+	group->err = err;
+	complete_all(&group->done);
+
+	spin_lock(&slot->lock);
+	slot->leaders--;
+	spin_unlock(&slot->lock);
+
+	fsync_group_put(group);
+	return err;
+
+direct:
+	return file->f_op->fsync(file, start, end, datasync);
+}
+EXPORT_SYMBOL(dyn_fsync_group_commit);
+
+
 // Functions
 
 static ssize_t dyn_fsync_active_show(struct kobject *kobj,
@@ -67,6 +235,31 @@ static ssize_t dyn_fsync_active_store(struct kobject *kobj,
 }
 
 
+static ssize_t dyn_fsync_group_commit_show(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", dyn_fsync_group_commit_us);
+}
+
+
+static ssize_t dyn_fsync_group_commit_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned int data;
+
+	if (sscanf(buf, "%u\n", &data) == 1 &&
+	    data <= DYN_FSYNC_GROUP_COMMIT_US_MAX)
+	{
+		pr_info("%s: group commit window %u us\n", __FUNCTION__, data);
+		dyn_fsync_group_commit_us = data;
+	}
+	else
+		pr_info("%s: bad value!\n", __FUNCTION__);
+
+	return count;
+}
+
+
 static ssize_t dyn_fsync_version_show(struct kobject *kobj,
 		struct kobj_attribute *attr, char *buf)
 {
@@ -156,6 +349,11 @@ static struct kobj_attribute dyn_fsync_active_attribute =
 		dyn_fsync_active_show,
 		dyn_fsync_active_store);
 
+static struct kobj_attribute dyn_fsync_group_commit_attribute = 
+	__ATTR(Dyn_fsync_group_commit_us, 0644,
+		dyn_fsync_group_commit_show,
+		dyn_fsync_group_commit_store);
+
 static struct kobj_attribute dyn_fsync_version_attribute = 
 	__ATTR(Dyn_fsync_version, 0444, dyn_fsync_version_show, NULL);
 
@@ -165,6 +363,7 @@ static struct kobj_attribute dyn_fsync_suspend_attribute =
 static struct attribute *dyn_fsync_active_attrs[] =
 {
 	&dyn_fsync_active_attribute.attr,
+	&dyn_fsync_group_commit_attribute.attr,
 	&dyn_fsync_version_attribute.attr,
 	&dyn_fsync_suspend_attribute.attr,
 	NULL,
@@ -189,6 +388,10 @@ static struct kobject *dyn_fsync_kobj;
 static int dyn_fsync_init(void)
 {
 	int sysfs_result;
+	int i;
+
+	for (i = 0; i < FSYNC_GROUP_SLOTS; i++)
+		spin_lock_init(&fsync_group_slots[i].lock);
 
 	register_reboot_notifier(&dyn_fsync_notifier);
 	
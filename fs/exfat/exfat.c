@@ -93,22 +93,6 @@ static INT8 *reserved_names[] = {
 	NULL
 };
 
-static UINT8 free_bit[] = {
-	0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2,
-	0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 5, 0, 1, 0, 2, 0, 1, 0, 3,
-	0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2,
-	0, 1, 0, 6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4,
-	0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 5, 0, 1, 0, 2,
-	0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3,
-	0, 1, 0, 2, 0, 1, 0, 7, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2,
-	0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 5,
-	0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2,
-	0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 6, 0, 1, 0, 2, 0, 1, 0, 3,
-	0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2,
-	0, 1, 0, 5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4,
-	0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
-};
-
 static UINT8 used_bit[] = {
 	0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3,
 	2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2, 3, 2, 3, 3, 4,
@@ -1265,7 +1249,7 @@ INT32 ffsSetStat(struct inode *inode, DIR_ENTRY_T *info)
 	return FFS_SUCCESS;
 }
 
-INT32 ffsMapCluster(struct inode *inode, INT32 clu_offset, UINT32 *clu)
+INT32 ffsMapCluster(struct inode *inode, INT32 clu_offset, UINT32 *clu, INT32 alloc)
 {
 	INT32 num_clusters, num_alloced, modified = FALSE;
 	UINT32 last_clu, sector;
@@ -1310,6 +1294,9 @@ INT32 ffsMapCluster(struct inode *inode, INT32 clu_offset, UINT32 *clu)
 	}
 
 	if (*clu == CLUSTER_32(~0)) {
+		if (!alloc)
+			return FFS_SUCCESS;
+
 		fs_set_vol_flags(sb, VOL_DIRTY);
 
 		new_clu.dir = (last_clu == CLUSTER_32(~0)) ? CLUSTER_32(~0) : last_clu+1;
@@ -1786,6 +1773,41 @@ INT32 clear_cluster(struct super_block *sb, UINT32 clu)
 	return ret;
 }
 
+/*
+ * Each sector of the allocation bitmap keeps a count of the free clusters
+ * it describes in vol_amap_free[], so that searches skip full sectors
+ * without looking at them and the used cluster count is a short sum.
+ */
+static INT32 amap_sector_bits(struct super_block *sb, INT32 map_i)
+{
+	UINT32 first, bits;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
+
+	bits = p_bd->sector_size << 3;
+	first = map_i << (p_bd->sector_size_bits + 3);
+
+	if (first >= p_fs->num_clusters - 2)
+		return 0;
+	if (first + bits > p_fs->num_clusters - 2)
+		bits = p_fs->num_clusters - 2 - first;
+
+	return(bits);
+}
+
+static INT32 amap_count_used(UINT8 *map, INT32 nbits)
+{
+	INT32 i, count = 0;
+
+	for (i = 0; i < (nbits >> 3); i++)
+		count += used_bit[map[i]];
+
+	for (i <<= 3; i < nbits; i++)
+		count += Bitmap_test(map, i);
+
+	return(count);
+}
+
 INT32 fat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_chain)
 {
 	INT32 i, num_clusters = 0;
@@ -1841,8 +1863,8 @@ INT32 fat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_chai
 
 INT32 exfat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_chain)
 {
-	INT32 num_clusters = 0;
-	UINT32 hint_clu, new_clu, last_clu = CLUSTER_32(~0);
+	INT32 len, num_clusters = 0;
+	UINT32 hint_clu, new_clu, clu, last_clu = CLUSTER_32(~0);
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	hint_clu = p_chain->dir;
@@ -1859,6 +1881,11 @@ INT32 exfat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_ch
 
 	p_chain->dir = CLUSTER_32(~0);
 
+	/*
+	 * Take free clusters a whole run at a time: a run that starts at the
+	 * hint keeps a NoFatChain file contiguous without touching the FAT,
+	 * and only a chained file has to link the run up cluster by cluster.
+	 */
 	while ((new_clu = test_alloc_bitmap(sb, hint_clu-2)) != CLUSTER_32(~0)) {
 		if (new_clu != hint_clu) {
 			if (p_chain->flags == 0x03) {
@@ -1867,13 +1894,18 @@ INT32 exfat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_ch
 			}
 		}
 
-		if (set_alloc_bitmap(sb, new_clu-2) != FFS_SUCCESS)
+		len = set_alloc_bitmap_run(sb, new_clu-2, num_alloc);
+		if (len < 0)
 			return -1;
 
-		num_clusters++;
+		num_clusters += len;
 
 		if (p_chain->flags == 0x01) {
-			if(FAT_write(sb, new_clu, CLUSTER_32(~0)) < 0)
+			for (clu = new_clu; clu < new_clu + len - 1; clu++) {
+				if (FAT_write(sb, clu, clu+1) < 0)
+					return -1;
+			}
+			if (FAT_write(sb, clu, CLUSTER_32(~0)) < 0)
 				return -1;
 		}
 
@@ -1885,26 +1917,21 @@ INT32 exfat_alloc_cluster(struct super_block *sb, INT32 num_alloc, CHAIN_T *p_ch
 					return -1;
 			}
 		}
-		last_clu = new_clu;
+		last_clu = new_clu + len - 1;
 
-		if ((--num_alloc) == 0) {
-			p_fs->clu_srch_ptr = hint_clu;
-			if (p_fs->used_clusters != (UINT32) ~0)
-				p_fs->used_clusters += num_clusters;
-
-			p_chain->size += num_clusters;
-			return(num_clusters);
-		}
-
-		hint_clu = new_clu + 1;
+		hint_clu = last_clu + 1;
 		if (hint_clu >= p_fs->num_clusters) {
 			hint_clu = 2;
 
-			if (p_chain->flags == 0x03) {
+			if ((num_alloc > len) && (p_chain->flags == 0x03)) {
 				exfat_chain_cont_cluster(sb, p_chain->dir, num_clusters);
 				p_chain->flags = 0x01;
 			}
 		}
+
+		num_alloc -= len;
+		if (num_alloc == 0)
+			break;
 	}
 
 	p_fs->clu_srch_ptr = hint_clu;
@@ -2081,25 +2108,11 @@ INT32 fat_count_used_clusters(struct super_block *sb)
 
 INT32 exfat_count_used_clusters(struct super_block *sb)
 {
-	INT32 i, map_i, map_b, count = 0;
-	UINT8 k;
+	INT32 i, count = 0;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
-	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
-
-	map_i = map_b = 0;
 
-	for (i = 2; i < p_fs->num_clusters; i += 8) {
-		k = *(((UINT8 *) p_fs->vol_amap[map_i]->b_data) + map_b);
-		count += used_bit[k];
-
-		if ((++map_b) >= p_bd->sector_size) {
-			map_i++;
-			map_b = 0;
-		}
-	}
-
-	if ((p_fs->num_clusters - 2) < (UINT32)count)
-		count = p_fs->num_clusters - 2;
+	for (i = 0; i < p_fs->map_sectors; i++)
+		count += amap_sector_bits(sb, i) - p_fs->vol_amap_free[i];
 
 	return(count);
 }
@@ -2173,6 +2186,21 @@ INT32 load_alloc_bitmap(struct super_block *sb)
 					}
 				}
 
+				p_fs->vol_amap_free = (UINT16 *) MALLOC(sizeof(UINT16) * p_fs->map_sectors);
+				if (p_fs->vol_amap_free == NULL) {
+					for (j = 0; j < p_fs->map_sectors; j++)
+						brelse(p_fs->vol_amap[j]);
+
+					FREE(p_fs->vol_amap);
+					p_fs->vol_amap = NULL;
+					return FFS_MEMORYERR;
+				}
+
+				for (j = 0; j < p_fs->map_sectors; j++)
+					p_fs->vol_amap_free[j] = amap_sector_bits(sb, j) -
+						amap_count_used((UINT8 *) p_fs->vol_amap[j]->b_data,
+								amap_sector_bits(sb, j));
+
 				p_fs->pbr_bh = NULL;
 				return FFS_SUCCESS;
 			}
@@ -2198,6 +2226,9 @@ void free_alloc_bitmap(struct super_block *sb)
 
 	FREE(p_fs->vol_amap);
 	p_fs->vol_amap = NULL;
+
+	FREE(p_fs->vol_amap_free);
+	p_fs->vol_amap_free = NULL;
 }
 
 INT32 set_alloc_bitmap(struct super_block *sb, UINT32 clu)
@@ -2212,11 +2243,48 @@ INT32 set_alloc_bitmap(struct super_block *sb, UINT32 clu)
 
 	sector = START_SECTOR(p_fs->map_clu) + i;
 
-	Bitmap_set((UINT8 *) p_fs->vol_amap[i]->b_data, b);
+	if (!Bitmap_test((UINT8 *) p_fs->vol_amap[i]->b_data, b)) {
+		Bitmap_set((UINT8 *) p_fs->vol_amap[i]->b_data, b);
+		p_fs->vol_amap_free[i]--;
+	}
 
 	return (sector_write(sb, sector, p_fs->vol_amap[i], 0));
 }
 
+/*
+ * Mark the free run starting at clu as allocated, up to max clusters and
+ * no further than the end of its bitmap sector, and dirty that sector
+ * once for the whole run.  Returns the length of the run.
+ */
+INT32 set_alloc_bitmap_run(struct super_block *sb, UINT32 clu, INT32 max)
+{
+	INT32 i, b, end, len;
+	UINT32 sector;
+	UINT8 *map;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
+
+	i = clu >> (p_bd->sector_size_bits + 3);
+	b = clu & ((p_bd->sector_size << 3) - 1);
+	map = (UINT8 *) p_fs->vol_amap[i]->b_data;
+
+	end = find_next_bit_le(map, amap_sector_bits(sb, i), b);
+	len = min(end - b, max);
+	if (len <= 0)
+		return -1;
+
+	for (end = b + len; b < end; b++)
+		Bitmap_set(map, b);
+	p_fs->vol_amap_free[i] -= len;
+
+	sector = START_SECTOR(p_fs->map_clu) + i;
+
+	if (sector_write(sb, sector, p_fs->vol_amap[i], 0) != FFS_SUCCESS)
+		return -1;
+
+	return(len);
+}
+
 INT32 clr_alloc_bitmap(struct super_block *sb, UINT32 clu)
 {
 	INT32 i, b;
@@ -2234,7 +2302,10 @@ INT32 clr_alloc_bitmap(struct super_block *sb, UINT32 clu)
 
 	sector = START_SECTOR(p_fs->map_clu) + i;
 
-	Bitmap_clear((UINT8 *) p_fs->vol_amap[i]->b_data, b);
+	if (Bitmap_test((UINT8 *) p_fs->vol_amap[i]->b_data, b)) {
+		Bitmap_clear((UINT8 *) p_fs->vol_amap[i]->b_data, b);
+		p_fs->vol_amap_free[i]++;
+	}
 
 	return (sector_write(sb, sector, p_fs->vol_amap[i], 0));
 
@@ -2255,38 +2326,30 @@ INT32 clr_alloc_bitmap(struct super_block *sb, UINT32 clu)
 
 UINT32 test_alloc_bitmap(struct super_block *sb, UINT32 clu)
 {
-	INT32 i, map_i, map_b;
-	UINT32 clu_base, clu_free;
-	UINT8 k, clu_mask;
+	INT32 i, map_i, bits, b, start;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
 
-	clu_base = (clu & ~(0x7)) + 2;
-	clu_mask = (1 << (clu - clu_base + 2)) - 1;
-
 	map_i = clu >> (p_bd->sector_size_bits + 3);
-	map_b = (clu >> 3) & p_bd->sector_size_mask;
+	start = clu & ((p_bd->sector_size << 3) - 1);
 
-	for (i = 2; i < p_fs->num_clusters; i += 8) {
-		k = *(((UINT8 *) p_fs->vol_amap[map_i]->b_data) + map_b);
-		if (clu_mask > 0) {
-			k |= clu_mask;
-			clu_mask = 0;
-		}
-		if (k < 0xFF) {
-			clu_free = clu_base + free_bit[k];
-			if (clu_free < p_fs->num_clusters)
-				return(clu_free);
-		}
-		clu_base += 8;
+	if (map_i >= p_fs->map_sectors) {
+		map_i = 0;
+		start = 0;
+	}
 
-		if (((++map_b) >= p_bd->sector_size) || (clu_base >= p_fs->num_clusters)) {
-			if ((++map_i) >= p_fs->map_sectors) {
-				clu_base = 2;
-				map_i = 0;
-			}
-			map_b = 0;
+	/* the extra pass wraps back round to the bits before clu */
+	for (i = 0; i <= p_fs->map_sectors; i++) {
+		if (p_fs->vol_amap_free[map_i] > 0) {
+			bits = amap_sector_bits(sb, map_i);
+			b = find_next_zero_bit_le(p_fs->vol_amap[map_i]->b_data, bits, start);
+			if (b < bits)
+				return((map_i << (p_bd->sector_size_bits + 3)) + b + 2);
 		}
+
+		start = 0;
+		if ((++map_i) >= p_fs->map_sectors)
+			map_i = 0;
 	}
 
 	return(CLUSTER_32(~0));
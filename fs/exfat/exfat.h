@@ -423,6 +423,7 @@ extern "C" {
 		UINT32      map_clu;
 		UINT32      map_sectors;
 		struct buffer_head **vol_amap;
+		UINT16      *vol_amap_free;
 
 		UINT16      **vol_utbl;
 
@@ -434,13 +435,20 @@ extern "C" {
 
 		FS_FUNC_T	*fs_func;
 
-		BUF_CACHE_T FAT_cache_array[FAT_CACHE_SIZE];
+		struct semaphore FAT_cache_sem;
+		UINT32      FAT_cache_size;
+		UINT32      FAT_cache_hash_size;
+		BUF_CACHE_T *FAT_cache_array;
 		BUF_CACHE_T FAT_cache_lru_list;
-		BUF_CACHE_T FAT_cache_hash_list[FAT_CACHE_HASH_SIZE];
+		BUF_CACHE_T *FAT_cache_hash_list;
+		UINT32      FAT_ra_start;
+		UINT32      FAT_ra_end;
 
-		BUF_CACHE_T buf_cache_array[BUF_CACHE_SIZE];
+		UINT32      buf_cache_size;
+		UINT32      buf_cache_hash_size;
+		BUF_CACHE_T *buf_cache_array;
 		BUF_CACHE_T buf_cache_lru_list;
-		BUF_CACHE_T buf_cache_hash_list[BUF_CACHE_HASH_SIZE];
+		BUF_CACHE_T *buf_cache_hash_list;
 	} FS_INFO_T;
 
 #define ES_2_ENTRIES		2
@@ -475,7 +483,7 @@ extern "C" {
 	INT32 ffsSetAttr(struct inode *inode, UINT32 attr);
 	INT32 ffsGetStat(struct inode *inode, DIR_ENTRY_T *info);
 	INT32 ffsSetStat(struct inode *inode, DIR_ENTRY_T *info);
-	INT32 ffsMapCluster(struct inode *inode, INT32 clu_offset, UINT32 *clu);
+	INT32 ffsMapCluster(struct inode *inode, INT32 clu_offset, UINT32 *clu, INT32 alloc);
 
 	INT32 ffsCreateDir(struct inode *inode, UINT8 *path, FILE_ID_T *fid);
 	INT32 ffsReadDir(struct inode *inode, DIR_ENTRY_T *dir_ent);
@@ -502,6 +510,7 @@ extern "C" {
 	INT32  load_alloc_bitmap(struct super_block *sb);
 	void   free_alloc_bitmap(struct super_block *sb);
 	INT32   set_alloc_bitmap(struct super_block *sb, UINT32 clu);
+	INT32   set_alloc_bitmap_run(struct super_block *sb, UINT32 clu, INT32 max);
 	INT32   clr_alloc_bitmap(struct super_block *sb, UINT32 clu);
 	UINT32 test_alloc_bitmap(struct super_block *sb, UINT32 clu);
 	void   sync_alloc_bitmap(struct super_block *sb);
@@ -186,6 +186,12 @@ INT32 FsCreateFile(struct inode *inode, UINT8 *path, UINT8 mode, FILE_ID_T *fid)
 	return(err);
 }
 
+/*
+ * FsReadFile, FsWriteFile and FsRemoveFile only run on a FILE_ID_T that is
+ * private to the caller (a symlink being created or looked up), never on
+ * an inode's fid, so they need no fid_lock.  Unlinking a file keeps its
+ * cluster chain until evict, which frees it under fid_lock.
+ */
 INT32 FsReadFile(struct inode *inode, FILE_ID_T *fid, void *buffer, UINT64 count, UINT64 *rcount)
 {
 	INT32 err;
@@ -224,6 +230,7 @@ INT32 FsWriteFile(struct inode *inode, FILE_ID_T *fid, void *buffer, UINT64 coun
 	return(err);
 }
 
+/* Called with the inode's fid_lock held. */
 INT32 FsTruncateFile(struct inode *inode, UINT64 old_size, UINT64 new_size)
 {
 	INT32 err;
@@ -326,6 +333,13 @@ INT32 FsWriteStat(struct inode *inode, DIR_ENTRY_T *info)
 	return(err);
 }
 
+/*
+ * Called with the inode's fid_lock held.  Mapping a cluster the file
+ * already has only walks the FAT, which the FAT cache locks by itself,
+ * so readers of one file do not wait for the volume semaphore held by
+ * a writer or a directory operation on another.  Only allocating a new
+ * cluster, which touches the bitmap and the directory entry, takes it.
+ */
 INT32 FsMapCluster(struct inode *inode, INT32 clu_offset, UINT32 *clu)
 {
 	INT32 err;
@@ -334,9 +348,13 @@ INT32 FsMapCluster(struct inode *inode, INT32 clu_offset, UINT32 *clu)
 
 	if (clu == NULL) return(FFS_ERROR);
 
+	err = ffsMapCluster(inode, clu_offset, clu, FALSE);
+	if (err || (*clu != CLUSTER_32(~0)))
+		return(err);
+
 	sm_P(&(fs_struct[p_fs->drv].v_sem));
 
-	err = ffsMapCluster(inode, clu_offset, clu);
+	err = ffsMapCluster(inode, clu_offset, clu, TRUE);
 
 	sm_V(&(fs_struct[p_fs->drv].v_sem));
 
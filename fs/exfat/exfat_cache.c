@@ -16,9 +16,13 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <linux/blkdev.h>
+#include <linux/log2.h>
+
 #include "exfat_config.h"
 #include "exfat_global.h"
 #include "exfat_data.h"
+#include "exfat_oal.h"
 
 #include "exfat_cache.h"
 #include "exfat_super.h"
@@ -26,8 +30,14 @@
 
 extern FS_STRUCT_T      fs_struct[];
 
-#define sm_P(s)
-#define sm_V(s)
+/*
+ * The FAT cache is also used by block mapping, which runs without the
+ * volume semaphore, so it has a lock of its own.  The buffer cache only
+ * holds directory sectors, which are always accessed under the volume
+ * semaphore and need no further locking.
+ */
+#define buf_sm_P(s)
+#define buf_sm_V(s)
 
 static INT32 __FAT_read(struct super_block *sb, UINT32 loc, UINT32 *content);
 static INT32 __FAT_write(struct super_block *sb, UINT32 loc, UINT32 content);
@@ -36,6 +46,7 @@ static BUF_CACHE_T *FAT_cache_find(struct super_block *sb, UINT32 sec);
 static BUF_CACHE_T *FAT_cache_get(struct super_block *sb, UINT32 sec);
 static void FAT_cache_insert_hash(struct super_block *sb, BUF_CACHE_T *bp);
 static void FAT_cache_remove_hash(BUF_CACHE_T *bp);
+static void FAT_readahead(struct super_block *sb, UINT32 sec);
 
 static UINT8 *__buf_getblk(struct super_block *sb, UINT32 sec);
 
@@ -49,15 +60,57 @@ static void push_to_lru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
 static void move_to_mru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
 static void move_to_lru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
 
+/*
+ * The caches are sized from the size of the volume: a big SD card has a
+ * proportionally bigger FAT and more directories, and a fixed number of
+ * cached sectors turns a long cluster chain walk into a stream of misses.
+ */
+static UINT32 cache_size_for_volume(struct super_block *sb, UINT32 min_size,
+				    UINT32 max_size, INT32 bytes_per_entry_bits)
+{
+	UINT64 dev_size = i_size_read(sb->s_bdev->bd_inode);
+	UINT32 size;
+
+	size = (UINT32) min_t(UINT64, dev_size >> bytes_per_entry_bits, max_size);
+	if (size < min_size)
+		size = min_size;
+
+	return(roundup_pow_of_two(size));
+}
+
 INT32 buf_init(struct super_block *sb)
 {
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	INT32 i;
 
+	p_fs->FAT_cache_size = cache_size_for_volume(sb, FAT_CACHE_SIZE,
+					FAT_CACHE_MAX_SIZE, FAT_CACHE_SCALE_BITS);
+	p_fs->FAT_cache_hash_size = p_fs->FAT_cache_size >> 1;
+	p_fs->buf_cache_size = cache_size_for_volume(sb, BUF_CACHE_SIZE,
+					BUF_CACHE_MAX_SIZE, BUF_CACHE_SCALE_BITS);
+	p_fs->buf_cache_hash_size = p_fs->buf_cache_size >> 2;
+
+	p_fs->FAT_cache_array = kcalloc(p_fs->FAT_cache_size + p_fs->FAT_cache_hash_size,
+					sizeof(BUF_CACHE_T), GFP_KERNEL);
+	p_fs->buf_cache_array = kcalloc(p_fs->buf_cache_size + p_fs->buf_cache_hash_size,
+					sizeof(BUF_CACHE_T), GFP_KERNEL);
+	if (!p_fs->FAT_cache_array || !p_fs->buf_cache_array) {
+		FREE(p_fs->FAT_cache_array);
+		FREE(p_fs->buf_cache_array);
+		p_fs->FAT_cache_array = p_fs->buf_cache_array = NULL;
+		return(FFS_MEMORYERR);
+	}
+	p_fs->FAT_cache_hash_list = p_fs->FAT_cache_array + p_fs->FAT_cache_size;
+	p_fs->buf_cache_hash_list = p_fs->buf_cache_array + p_fs->buf_cache_size;
+
+	p_fs->FAT_ra_start = p_fs->FAT_ra_end = 0;
+
+	sm_init(&p_fs->FAT_cache_sem);
+
 	p_fs->FAT_cache_lru_list.next = p_fs->FAT_cache_lru_list.prev = &p_fs->FAT_cache_lru_list;
 
-	for (i = 0; i < FAT_CACHE_SIZE; i++) {
+	for (i = 0; i < p_fs->FAT_cache_size; i++) {
 		p_fs->FAT_cache_array[i].drv = -1;
 		p_fs->FAT_cache_array[i].sec = ~0;
 		p_fs->FAT_cache_array[i].flag = 0;
@@ -68,7 +121,7 @@ INT32 buf_init(struct super_block *sb)
 
 	p_fs->buf_cache_lru_list.next = p_fs->buf_cache_lru_list.prev = &p_fs->buf_cache_lru_list;
 
-	for (i = 0; i < BUF_CACHE_SIZE; i++) {
+	for (i = 0; i < p_fs->buf_cache_size; i++) {
 		p_fs->buf_cache_array[i].drv = -1;
 		p_fs->buf_cache_array[i].sec = ~0;
 		p_fs->buf_cache_array[i].flag = 0;
@@ -77,23 +130,23 @@ INT32 buf_init(struct super_block *sb)
 		push_to_mru(&(p_fs->buf_cache_array[i]), &p_fs->buf_cache_lru_list);
 	}
 
-	for (i = 0; i < FAT_CACHE_HASH_SIZE; i++) {
+	for (i = 0; i < p_fs->FAT_cache_hash_size; i++) {
 		p_fs->FAT_cache_hash_list[i].drv = -1;
 		p_fs->FAT_cache_hash_list[i].sec = ~0;
 		p_fs->FAT_cache_hash_list[i].hash_next = p_fs->FAT_cache_hash_list[i].hash_prev = &(p_fs->FAT_cache_hash_list[i]);
 	}
 
-	for (i = 0; i < FAT_CACHE_SIZE; i++) {
+	for (i = 0; i < p_fs->FAT_cache_size; i++) {
 		FAT_cache_insert_hash(sb, &(p_fs->FAT_cache_array[i]));
 	}
 
-	for (i = 0; i < BUF_CACHE_HASH_SIZE; i++) {
+	for (i = 0; i < p_fs->buf_cache_hash_size; i++) {
 		p_fs->buf_cache_hash_list[i].drv = -1;
 		p_fs->buf_cache_hash_list[i].sec = ~0;
 		p_fs->buf_cache_hash_list[i].hash_next = p_fs->buf_cache_hash_list[i].hash_prev = &(p_fs->buf_cache_hash_list[i]);
 	}
 
-	for (i = 0; i < BUF_CACHE_SIZE; i++) {
+	for (i = 0; i < p_fs->buf_cache_size; i++) {
 		buf_cache_insert_hash(sb, &(p_fs->buf_cache_array[i]));
 	}
 
@@ -102,18 +155,26 @@ INT32 buf_init(struct super_block *sb)
 
 INT32 buf_shutdown(struct super_block *sb)
 {
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	FREE(p_fs->FAT_cache_array);
+	FREE(p_fs->buf_cache_array);
+	p_fs->FAT_cache_array = p_fs->buf_cache_array = NULL;
+	p_fs->FAT_cache_hash_list = p_fs->buf_cache_hash_list = NULL;
+
 	return(FFS_SUCCESS);
 }
 
 INT32 FAT_read(struct super_block *sb, UINT32 loc, UINT32 *content)
 {
 	INT32 ret;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	sm_P(&f_sem);
+	sm_P(&p_fs->FAT_cache_sem);
 
 	ret = __FAT_read(sb, loc, content);
 
-	sm_V(&f_sem);
+	sm_V(&p_fs->FAT_cache_sem);
 
 	return(ret);
 }
@@ -121,12 +182,13 @@ INT32 FAT_read(struct super_block *sb, UINT32 loc, UINT32 *content)
 INT32 FAT_write(struct super_block *sb, UINT32 loc, UINT32 content)
 {
 	INT32 ret;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	sm_P(&f_sem);
+	sm_P(&p_fs->FAT_cache_sem);
 
 	ret = __FAT_write(sb, loc, content);
 
-	sm_V(&f_sem);
+	sm_V(&p_fs->FAT_cache_sem);
 
 	return(ret);
 }
@@ -361,6 +423,8 @@ UINT8 *FAT_getblk(struct super_block *sb, UINT32 sec)
 		return(bp->buf_bh->b_data);
 	}
 
+	FAT_readahead(sb, sec);
+
 	bp = FAT_cache_get(sb, sec);
 
 	FAT_cache_remove_hash(bp);
@@ -385,6 +449,41 @@ UINT8 *FAT_getblk(struct super_block *sb, UINT32 sec)
 	return(bp->buf_bh->b_data);
 }
 
+/*
+ * Chain walks and allocation move through the FAT in sector order, so on
+ * a miss start reading the following FAT sectors as well.  The window is
+ * remembered so that the misses it is about to satisfy do not issue it
+ * again.
+ */
+static void FAT_readahead(struct super_block *sb, UINT32 sec)
+{
+	UINT32 s, fat_start, fat_end;
+	struct blk_plug plug;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
+
+	if ((sec >= p_fs->FAT_ra_start) && (sec < p_fs->FAT_ra_end))
+		return;
+
+	if ((sec >= p_fs->FAT2_start_sector) &&
+	    (p_fs->FAT2_start_sector != p_fs->FAT1_start_sector))
+		fat_start = p_fs->FAT2_start_sector;
+	else
+		fat_start = p_fs->FAT1_start_sector;
+	fat_end = fat_start + p_fs->num_FAT_sectors;
+
+	if ((sec < fat_start) || (sec >= fat_end))
+		return;
+
+	blk_start_plug(&plug);
+	for (s = sec + 1; (s < sec + FAT_CACHE_RA_SIZE) && (s < fat_end); s++)
+		__breadahead(sb->s_bdev, s, p_bd->sector_size);
+	blk_finish_plug(&plug);
+
+	p_fs->FAT_ra_start = sec;
+	p_fs->FAT_ra_end = s;
+}
+
 void FAT_modify(struct super_block *sb, UINT32 sec)
 {
 	BUF_CACHE_T *bp;
@@ -400,7 +499,7 @@ void FAT_release_all(struct super_block *sb)
 	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	sm_P(&f_sem);
+	sm_P(&p_fs->FAT_cache_sem);
 
 	bp = p_fs->FAT_cache_lru_list.next;
 	while (bp != &p_fs->FAT_cache_lru_list) {
@@ -417,7 +516,7 @@ void FAT_release_all(struct super_block *sb)
 		bp = bp->next;
 	}
 
-	sm_V(&f_sem);
+	sm_V(&p_fs->FAT_cache_sem);
 }
 
 void FAT_sync(struct super_block *sb)
@@ -425,7 +524,7 @@ void FAT_sync(struct super_block *sb)
 	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	sm_P(&f_sem);
+	sm_P(&p_fs->FAT_cache_sem);
 
 	bp = p_fs->FAT_cache_lru_list.next;
 	while (bp != &p_fs->FAT_cache_lru_list) {
@@ -436,7 +535,7 @@ void FAT_sync(struct super_block *sb)
 		bp = bp->next;
 	}
 
-	sm_V(&f_sem);
+	sm_V(&p_fs->FAT_cache_sem);
 }
 
 static BUF_CACHE_T *FAT_cache_find(struct super_block *sb, UINT32 sec)
@@ -445,7 +544,7 @@ static BUF_CACHE_T *FAT_cache_find(struct super_block *sb, UINT32 sec)
 	BUF_CACHE_T *bp, *hp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & (FAT_CACHE_HASH_SIZE - 1);
+	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & (p_fs->FAT_cache_hash_size - 1);
 
 	hp = &(p_fs->FAT_cache_hash_list[off]);
 	for (bp = hp->hash_next; bp != hp; bp = bp->hash_next) {
@@ -480,7 +579,7 @@ static void FAT_cache_insert_hash(struct super_block *sb, BUF_CACHE_T *bp)
 	FS_INFO_T *p_fs;
 
 	p_fs = &(EXFAT_SB(sb)->fs_info);
-	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & (FAT_CACHE_HASH_SIZE-1);
+	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & (p_fs->FAT_cache_hash_size - 1);
 
 	hp = &(p_fs->FAT_cache_hash_list[off]);
 	bp->hash_next = hp->hash_next;
@@ -499,11 +598,11 @@ UINT8 *buf_getblk(struct super_block *sb, UINT32 sec)
 {
 	UINT8 *buf;
 
-	sm_P(&b_sem);
+	buf_sm_P(&b_sem);
 
 	buf = __buf_getblk(sb, sec);
 
-	sm_V(&b_sem);
+	buf_sm_V(&b_sem);
 
 	return(buf);
 }
@@ -548,7 +647,7 @@ void buf_modify(struct super_block *sb, UINT32 sec)
 {
 	BUF_CACHE_T *bp;
 
-	sm_P(&b_sem);
+	buf_sm_P(&b_sem);
 
 	bp = buf_cache_find(sb, sec);
 	if (likely(bp != NULL)) {
@@ -557,35 +656,35 @@ void buf_modify(struct super_block *sb, UINT32 sec)
 
 	WARN(!bp, "[EXFAT] failed to find buffer_cache(sector:%u).\n", sec);
 
-	sm_V(&b_sem);
+	buf_sm_V(&b_sem);
 }
 
 void buf_lock(struct super_block *sb, UINT32 sec)
 {
 	BUF_CACHE_T *bp;
 
-	sm_P(&b_sem);
+	buf_sm_P(&b_sem);
 
 	bp = buf_cache_find(sb, sec);
 	if (likely(bp != NULL)) bp->flag |= LOCKBIT;
 
 	WARN(!bp, "[EXFAT] failed to find buffer_cache(sector:%u).\n", sec);
 
-	sm_V(&b_sem);
+	buf_sm_V(&b_sem);
 }
 
 void buf_unlock(struct super_block *sb, UINT32 sec)
 {
 	BUF_CACHE_T *bp;
 
-	sm_P(&b_sem);
+	buf_sm_P(&b_sem);
 
 	bp = buf_cache_find(sb, sec);
 	if (likely(bp != NULL)) bp->flag &= ~(LOCKBIT);
 
 	WARN(!bp, "[EXFAT] failed to find buffer_cache(sector:%u).\n", sec);
 
-	sm_V(&b_sem);
+	buf_sm_V(&b_sem);
 }
 
 void buf_release(struct super_block *sb, UINT32 sec)
@@ -593,7 +692,7 @@ void buf_release(struct super_block *sb, UINT32 sec)
 	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	sm_P(&b_sem);
+	buf_sm_P(&b_sem);
 
 	bp = buf_cache_find(sb, sec);
 	if (likely(bp != NULL)) {
@@ -609,7 +708,7 @@ void buf_release(struct super_block *sb, UINT32 sec)
 		move_to_lru(bp, &p_fs->buf_cache_lru_list);
 	}
 
-	sm_V(&b_sem);
+	buf_sm_V(&b_sem);
 }
 
 void buf_release_all(struct super_block *sb)
@@ -617,7 +716,7 @@ void buf_release_all(struct super_block *sb)
 	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	sm_P(&b_sem);
+	buf_sm_P(&b_sem);
 
 	bp = p_fs->buf_cache_lru_list.next;
 	while (bp != &p_fs->buf_cache_lru_list) {
@@ -634,7 +733,7 @@ void buf_release_all(struct super_block *sb)
 		bp = bp->next;
 	}
 
-	sm_V(&b_sem);
+	buf_sm_V(&b_sem);
 }
 
 void buf_sync(struct super_block *sb)
@@ -642,7 +741,7 @@ void buf_sync(struct super_block *sb)
 	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	sm_P(&b_sem);
+	buf_sm_P(&b_sem);
 
 	bp = p_fs->buf_cache_lru_list.next;
 	while (bp != &p_fs->buf_cache_lru_list) {
@@ -653,7 +752,7 @@ void buf_sync(struct super_block *sb)
 		bp = bp->next;
 	}
 
-	sm_V(&b_sem);
+	buf_sm_V(&b_sem);
 }
 
 static BUF_CACHE_T *buf_cache_find(struct super_block *sb, UINT32 sec)
@@ -662,7 +761,7 @@ static BUF_CACHE_T *buf_cache_find(struct super_block *sb, UINT32 sec)
 	BUF_CACHE_T *bp, *hp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & (BUF_CACHE_HASH_SIZE - 1);
+	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & (p_fs->buf_cache_hash_size - 1);
 
 	hp = &(p_fs->buf_cache_hash_list[off]);
 	for (bp = hp->hash_next; bp != hp; bp = bp->hash_next) {
@@ -694,7 +793,7 @@ static void buf_cache_insert_hash(struct super_block *sb, BUF_CACHE_T *bp)
 	FS_INFO_T *p_fs;
 
 	p_fs = &(EXFAT_SB(sb)->fs_info);
-	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & (BUF_CACHE_HASH_SIZE-1);
+	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & (p_fs->buf_cache_hash_size - 1);
 
 	hp = &(p_fs->buf_cache_hash_list[off]);
 	bp->hash_next = hp->hash_next;
@@ -31,6 +31,11 @@ extern "C" {
 #define FAT_CACHE_HASH_SIZE     64
 #define BUF_CACHE_SIZE          256
 #define BUF_CACHE_HASH_SIZE     64
+#define FAT_CACHE_MAX_SIZE      1024
+#define FAT_CACHE_SCALE_BITS    25
+#define FAT_CACHE_RA_SIZE       16
+#define BUF_CACHE_MAX_SIZE      1024
+#define BUF_CACHE_SCALE_BITS    26
 #define DEFAULT_CODEPAGE        437
 #define DEFAULT_IOCHARSET       "utf8"
 #ifdef __cplusplus
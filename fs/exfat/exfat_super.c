@@ -967,9 +967,11 @@ static int exfat_unlink(struct inode *dir, struct dentry *dentry)
 
 	ts = CURRENT_TIME_SEC;
 
+	mutex_lock(&EXFAT_I(inode)->fid_lock);
 	EXFAT_I(inode)->fid.size = i_size_read(inode);
 
 	err = FsRemoveEntry(dir, &(EXFAT_I(inode)->fid));
+	mutex_unlock(&EXFAT_I(inode)->fid_lock);
 	if (err) {
 		if (err == FFS_PERMISSIONERR)
 			err = -EPERM;
@@ -1142,9 +1144,11 @@ static int exfat_rmdir(struct inode *dir, struct dentry *dentry)
 
 	ts = CURRENT_TIME_SEC;
 
+	mutex_lock(&EXFAT_I(inode)->fid_lock);
 	EXFAT_I(inode)->fid.size = i_size_read(inode);
 
 	err = FsRemoveDir(dir, &(EXFAT_I(inode)->fid));
+	mutex_unlock(&EXFAT_I(inode)->fid_lock);
 	if (err) {
 		if (err == FFS_INVALIDPATH)
 			err = -EINVAL;
@@ -1177,6 +1181,23 @@ out:
 	return err;
 }
 
+/* Take the fid_lock of one or two inodes, in address order. */
+static void exfat_lock_fids(struct inode *a, struct inode *b)
+{
+	if (b && b < a)
+		swap(a, b);
+	mutex_lock(&EXFAT_I(a)->fid_lock);
+	if (b && b != a)
+		mutex_lock_nested(&EXFAT_I(b)->fid_lock, SINGLE_DEPTH_NESTING);
+}
+
+static void exfat_unlock_fids(struct inode *a, struct inode *b)
+{
+	if (b && b != a)
+		mutex_unlock(&EXFAT_I(b)->fid_lock);
+	mutex_unlock(&EXFAT_I(a)->fid_lock);
+}
+
 static int exfat_rename(struct inode *old_dir, struct dentry *old_dentry,
 						struct inode *new_dir, struct dentry *new_dentry)
 {
@@ -1195,9 +1216,15 @@ static int exfat_rename(struct inode *old_dir, struct dentry *old_dentry,
 
 	ts = CURRENT_TIME_SEC;
 
+	/*
+	 * FsMoveFile rewrites the source fid and, when a directory is
+	 * replaced, frees the target's cluster chain.
+	 */
+	exfat_lock_fids(old_inode, new_inode);
 	EXFAT_I(old_inode)->fid.size = i_size_read(old_inode);
 
 	err = FsMoveFile(old_dir, &(EXFAT_I(old_inode)->fid), new_dir, new_dentry);
+	exfat_unlock_fids(old_inode, new_inode);
 	if (err) {
 		if (err == FFS_PERMISSIONERR)
 			err = -EPERM;
@@ -1489,6 +1516,7 @@ static void _exfat_truncate(struct inode *inode, loff_t old_size)
 	int err;
 
 	__lock_super(sb);
+	mutex_lock(&EXFAT_I(inode)->fid_lock);
 
 	if (EXFAT_I(inode)->mmu_private > i_size_read(inode))
 		EXFAT_I(inode)->mmu_private = i_size_read(inode);
@@ -1507,6 +1535,7 @@ static void _exfat_truncate(struct inode *inode, loff_t old_size)
 	inode->i_blocks = ((i_size_read(inode) + (p_fs->cluster_size - 1))
 		   & ~((loff_t)p_fs->cluster_size - 1)) >> inode->i_blkbits;
 out:
+	mutex_unlock(&EXFAT_I(inode)->fid_lock);
 	__unlock_super(sb);
 }
 
@@ -1593,11 +1622,11 @@ static int exfat_get_block(struct inode *inode, sector_t iblock,
 	unsigned long mapped_blocks;
 	sector_t phys;
 
-	__lock_super(sb);
+	mutex_lock(&EXFAT_I(inode)->fid_lock);
 
 	err = exfat_bmap(inode, iblock, &phys, &mapped_blocks, &create);
 	if (err) {
-		__unlock_super(sb);
+		mutex_unlock(&EXFAT_I(inode)->fid_lock);
 		return err;
 	}
 
@@ -1611,7 +1640,7 @@ static int exfat_get_block(struct inode *inode, sector_t iblock,
 	}
 
 	bh_result->b_size = max_blocks << sb->s_blocksize_bits;
-	__unlock_super(sb);
+	mutex_unlock(&EXFAT_I(inode)->fid_lock);
 
 	return 0;
 }
@@ -2011,7 +2040,9 @@ static void exfat_evict_inode(struct inode *inode)
 		loff_t old_size = i_size_read(inode);
 		i_size_write(inode, 0);
 		EXFAT_I(inode)->fid.size = old_size;
+		mutex_lock(&EXFAT_I(inode)->fid_lock);
 		FsTruncateFile(inode, old_size, 0);
+		mutex_unlock(&EXFAT_I(inode)->fid_lock);
 	}
 
 	invalidate_inode_buffers(inode);
@@ -2540,6 +2571,7 @@ static void init_once(void *foo)
 	struct exfat_inode_info *ei = (struct exfat_inode_info *)foo;
 
 	INIT_HLIST_NODE(&ei->i_hash_fat);
+	mutex_init(&ei->fid_lock);
 	inode_init_once(&ei->vfs_inode);
 }
 
@@ -99,6 +99,14 @@ struct exfat_inode_info {
 	loff_t mmu_private;
 	loff_t i_pos;
 	struct hlist_node i_hash_fat;
+	/*
+	 * Serialises block mapping against everything that changes this
+	 * file's fid (start cluster, flags, size, mapping hints, directory
+	 * entry) or frees its cluster chain: truncate, evict, unlink,
+	 * rmdir and rename.  Mapping then does not need the per-volume
+	 * locks unless it allocates.  Nests outside v_sem.
+	 */
+	struct mutex fid_lock;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,00)
 	struct rw_semaphore truncate_lock;
 #endif
@@ -77,6 +77,8 @@ typedef __u32 ext4_lblk_t;
 /* data type for block group number */
 typedef unsigned int ext4_group_t;
 
+#include "extents_status.h"
+
 /*
  * Flags used in mballoc's allocation_context flags field.
  *
@@ -863,6 +865,13 @@ struct ext4_inode_info {
 	struct jbd2_inode *jinode;
 
 	struct ext4_ext_cache i_cached_extent;
+
+	/* extent status tree, see extents_status.c */
+	rwlock_t i_es_lock;
+	struct ext4_es_tree i_es_tree;
+	struct list_head i_es_lru;
+	unsigned int i_es_lru_nr;	/* reclaimable extents in the tree */
+
 	/*
 	 * File creation time. Its function is same as that of
 	 * struct timespec i_{a,c,m}time in the generic inode.
@@ -1267,6 +1276,12 @@ struct ext4_sb_info {
 
 	/* record the last minlen when FITRIM is called. */
 	atomic_t s_last_trim_minblks;
+
+	/* extent status tree shrinker and statistics */
+	struct shrinker s_es_shrinker;
+	struct list_head s_es_lru;	/* inodes with reclaimable extents */
+	spinlock_t s_es_lru_lock;
+	struct ext4_es_stats s_es_stats;
 };
 
 static inline struct ext4_sb_info *EXT4_SB(struct super_block *sb)
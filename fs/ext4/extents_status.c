@@ -0,0 +1,631 @@
+/*
+ *  fs/ext4/extents_status.c
+ *
+ * In-memory extent status tree for ext4.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Every inode keeps an rb-tree of non-overlapping extents, each marked
+ * written, unwritten, hole or delayed.  ext4_map_blocks() looks here
+ * before taking i_data_sem and walking the on-disk extent tree or the
+ * indirect blocks.
+ *
+ * Written, unwritten and hole extents only cache the on-disk map: they
+ * are inserted by lookups with i_data_sem held, every path that changes
+ * the map drops the affected range while holding i_data_sem for write,
+ * and the shrinker may throw them away at any time.
+ *
+ * Delayed extents are the authoritative record of delalloc blocks: they
+ * are inserted when ext4_da_map_blocks() reserves a block and removed
+ * when the block is allocated or its page is released.  The shrinker
+ * never touches them.
+ *
+ * The tree itself is protected by i_es_lock.
+ */
+
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include "ext4.h"
+#include "ext4_extents.h"
+
+static struct kmem_cache *ext4_es_cachep;
+
+int __init ext4_init_es(void)
+{
+	ext4_es_cachep = KMEM_CACHE(extent_status, SLAB_RECLAIM_ACCOUNT);
+	if (ext4_es_cachep == NULL)
+		return -ENOMEM;
+	return 0;
+}
+
+void ext4_exit_es(void)
+{
+	if (ext4_es_cachep)
+		kmem_cache_destroy(ext4_es_cachep);
+}
+
+void ext4_es_init_tree(struct ext4_es_tree *tree)
+{
+	tree->root = RB_ROOT;
+	tree->cache_es = NULL;
+}
+
+static inline ext4_lblk_t ext4_es_end(struct extent_status *es)
+{
+	return es->es_lblk + es->es_len - 1;
+}
+
+/* last block of [lblk, lblk + len), clamped to the largest logical block */
+static inline ext4_lblk_t ext4_es_range_end(ext4_lblk_t lblk, ext4_lblk_t len)
+{
+	if (len > EXT_MAX_BLOCKS - lblk)
+		return EXT_MAX_BLOCKS - 1;
+	return lblk + len - 1;
+}
+
+/* es_pblk of @es as seen from logical block @lblk inside it */
+static inline ext4_fsblk_t ext4_es_pblk_at(struct extent_status *es,
+					   ext4_lblk_t lblk)
+{
+	if (ext4_es_is_written(es) || ext4_es_is_unwritten(es))
+		return es->es_pblk + (lblk - es->es_lblk);
+	return es->es_pblk;
+}
+
+static struct extent_status *ext4_es_next(struct extent_status *es)
+{
+	struct rb_node *node = rb_next(&es->rb_node);
+
+	return node ? rb_entry(node, struct extent_status, rb_node) : NULL;
+}
+
+/*
+ * Return the extent containing @lblk, or else the first extent after it.
+ */
+static struct extent_status *__es_tree_search(struct rb_root *root,
+					      ext4_lblk_t lblk)
+{
+	struct rb_node *node = root->rb_node;
+	struct extent_status *es = NULL;
+
+	while (node) {
+		es = rb_entry(node, struct extent_status, rb_node);
+		if (lblk < es->es_lblk)
+			node = node->rb_left;
+		else if (lblk > ext4_es_end(es))
+			node = node->rb_right;
+		else
+			return es;
+	}
+
+	if (es && lblk > ext4_es_end(es))
+		es = ext4_es_next(es);
+
+	return es;
+}
+
+static struct extent_status *
+ext4_es_alloc_extent(struct inode *inode, ext4_lblk_t lblk, ext4_lblk_t len,
+		     ext4_fsblk_t pblk, struct extent_status **spare)
+{
+	struct extent_status *es;
+
+	if (*spare) {
+		es = *spare;
+		*spare = NULL;
+	} else {
+		es = kmem_cache_alloc(ext4_es_cachep, GFP_ATOMIC);
+		if (es == NULL)
+			return NULL;
+	}
+	es->es_lblk = lblk;
+	es->es_len = len;
+	es->es_pblk = pblk;
+
+	if (!ext4_es_is_delayed(es)) {
+		EXT4_I(inode)->i_es_lru_nr++;
+		percpu_counter_inc(&EXT4_SB(inode->i_sb)->
+				   s_es_stats.es_stats_lru_cnt);
+	}
+	return es;
+}
+
+static void ext4_es_free_extent(struct inode *inode, struct extent_status *es)
+{
+	if (!ext4_es_is_delayed(es)) {
+		BUG_ON(EXT4_I(inode)->i_es_lru_nr == 0);
+		EXT4_I(inode)->i_es_lru_nr--;
+		percpu_counter_dec(&EXT4_SB(inode->i_sb)->
+				   s_es_stats.es_stats_lru_cnt);
+	}
+	kmem_cache_free(ext4_es_cachep, es);
+}
+
+static void ext4_es_erase(struct inode *inode, struct extent_status *es)
+{
+	rb_erase(&es->rb_node, &EXT4_I(inode)->i_es_tree.root);
+	ext4_es_free_extent(inode, es);
+}
+
+/* link @newes into the tree; it must not overlap any existing extent */
+static void ext4_es_link(struct ext4_es_tree *tree, struct extent_status *newes)
+{
+	struct rb_node **p = &tree->root.rb_node;
+	struct rb_node *parent = NULL;
+	struct extent_status *es;
+
+	while (*p) {
+		parent = *p;
+		es = rb_entry(parent, struct extent_status, rb_node);
+		if (newes->es_lblk < es->es_lblk)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&newes->rb_node, parent, p);
+	rb_insert_color(&newes->rb_node, &tree->root);
+}
+
+static int ext4_es_can_be_merged(struct extent_status *es1,
+				 struct extent_status *es2)
+{
+	if (ext4_es_status(es1) != ext4_es_status(es2))
+		return 0;
+
+	if ((__u64) es1->es_len + es2->es_len > EXT_MAX_BLOCKS)
+		return 0;
+
+	if (es1->es_lblk + es1->es_len != es2->es_lblk)
+		return 0;
+
+	if ((ext4_es_is_written(es1) || ext4_es_is_unwritten(es1)) &&
+	    ext4_es_pblock(es1) + es1->es_len != ext4_es_pblock(es2))
+		return 0;
+
+	return 1;
+}
+
+static struct extent_status *
+ext4_es_try_to_merge_left(struct inode *inode, struct extent_status *es)
+{
+	struct rb_node *node = rb_prev(&es->rb_node);
+	struct extent_status *es1;
+
+	if (!node)
+		return es;
+
+	es1 = rb_entry(node, struct extent_status, rb_node);
+	if (ext4_es_can_be_merged(es1, es)) {
+		es1->es_len += es->es_len;
+		ext4_es_erase(inode, es);
+		es = es1;
+	}
+	return es;
+}
+
+static struct extent_status *
+ext4_es_try_to_merge_right(struct inode *inode, struct extent_status *es)
+{
+	struct extent_status *es1 = ext4_es_next(es);
+
+	if (es1 && ext4_es_can_be_merged(es, es1)) {
+		es->es_len += es1->es_len;
+		ext4_es_erase(inode, es1);
+	}
+	return es;
+}
+
+static int __es_insert_extent(struct inode *inode, struct extent_status *newes,
+			      struct extent_status **spare)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct rb_node **p = &tree->root.rb_node;
+	struct rb_node *parent = NULL;
+	struct extent_status *es;
+
+	while (*p) {
+		parent = *p;
+		es = rb_entry(parent, struct extent_status, rb_node);
+
+		if (newes->es_lblk < es->es_lblk) {
+			if (ext4_es_can_be_merged(newes, es)) {
+				/* grow es to the left */
+				es->es_lblk = newes->es_lblk;
+				es->es_len += newes->es_len;
+				es->es_pblk = newes->es_pblk;
+				es = ext4_es_try_to_merge_left(inode, es);
+				goto out;
+			}
+			p = &(*p)->rb_left;
+		} else if (newes->es_lblk > ext4_es_end(es)) {
+			if (ext4_es_can_be_merged(es, newes)) {
+				es->es_len += newes->es_len;
+				es = ext4_es_try_to_merge_right(inode, es);
+				goto out;
+			}
+			p = &(*p)->rb_right;
+		} else {
+			BUG();
+			return -EINVAL;
+		}
+	}
+
+	es = ext4_es_alloc_extent(inode, newes->es_lblk, newes->es_len,
+				  newes->es_pblk, spare);
+	if (!es)
+		return -ENOMEM;
+	rb_link_node(&es->rb_node, parent, p);
+	rb_insert_color(&es->rb_node, &tree->root);
+out:
+	tree->cache_es = es;
+	return 0;
+}
+
+/*
+ * Drop [lblk, end] from the tree.  With @keep_delayed set, delayed extents
+ * are left alone.  Fails with -ENOMEM, leaving the tree untouched, only if
+ * a delayed extent has to be split and there is no memory for the tail.
+ */
+static int __es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+			      ext4_lblk_t end, int keep_delayed,
+			      struct extent_status **spare)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es, *next, *tail;
+	ext4_lblk_t len1, len2;
+
+	es = __es_tree_search(&tree->root, lblk);
+	if (!es || es->es_lblk > end)
+		return 0;
+
+	tree->cache_es = NULL;
+
+	len1 = lblk > es->es_lblk ? lblk - es->es_lblk : 0;
+	len2 = ext4_es_end(es) > end ? ext4_es_end(es) - end : 0;
+	if (len1 && len2 && !(keep_delayed && ext4_es_is_delayed(es))) {
+		/* the range is inside es: keep its head, add its tail */
+		tail = ext4_es_alloc_extent(inode, end + 1, len2,
+					    ext4_es_pblk_at(es, end + 1), spare);
+		if (!tail) {
+			if (ext4_es_is_delayed(es))
+				return -ENOMEM;
+			/* only cached state, forget all of it */
+			ext4_es_erase(inode, es);
+			return 0;
+		}
+		es->es_len = len1;
+		ext4_es_link(tree, tail);
+		return 0;
+	}
+
+	if (len1) {
+		if (!(keep_delayed && ext4_es_is_delayed(es)))
+			es->es_len = len1;
+		es = ext4_es_next(es);
+	}
+
+	while (es && ext4_es_end(es) <= end) {
+		next = ext4_es_next(es);
+		if (!(keep_delayed && ext4_es_is_delayed(es)))
+			ext4_es_erase(inode, es);
+		es = next;
+	}
+
+	if (es && es->es_lblk <= end &&
+	    !(keep_delayed && ext4_es_is_delayed(es))) {
+		/* cut the head off the last extent */
+		es->es_pblk = ext4_es_pblk_at(es, end + 1);
+		es->es_len = ext4_es_end(es) - end;
+		es->es_lblk = end + 1;
+	}
+
+	return 0;
+}
+
+static void ext4_es_lru_add(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	spin_lock(&sbi->s_es_lru_lock);
+	list_move_tail(&ei->i_es_lru, &sbi->s_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+}
+
+void ext4_es_lru_del(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	spin_lock(&sbi->s_es_lru_lock);
+	if (!list_empty(&ei->i_es_lru))
+		list_del_init(&ei->i_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+}
+
+/*
+ * ext4_es_insert_extent() records [lblk, lblk + len) with @status,
+ * replacing whatever the tree said about that range before.
+ */
+int ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
+			  ext4_lblk_t len, ext4_fsblk_t pblk,
+			  unsigned long long status)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status newes, *spare = NULL;
+	int err;
+
+	if (!len)
+		return 0;
+
+	newes.es_lblk = lblk;
+	newes.es_len = ext4_es_range_end(lblk, len) - lblk + 1;
+	newes.es_pblk = status;
+	if (status & (EXTENT_STATUS_WRITTEN | EXTENT_STATUS_UNWRITTEN))
+		newes.es_pblk |= pblk;
+
+retry:
+	write_lock(&ei->i_es_lock);
+	err = __es_remove_extent(inode, lblk, ext4_es_end(&newes), 0, &spare);
+	if (!err)
+		err = __es_insert_extent(inode, &newes, &spare);
+	write_unlock(&ei->i_es_lock);
+
+	/*
+	 * A lost delayed extent would corrupt the reservation accounting,
+	 * so don't give up on those just because GFP_ATOMIC failed.
+	 */
+	if (err == -ENOMEM && (status & EXTENT_STATUS_DELAYED) && !spare) {
+		spare = kmem_cache_alloc(ext4_es_cachep, GFP_NOFS);
+		if (spare)
+			goto retry;
+	}
+
+	if (spare)
+		kmem_cache_free(ext4_es_cachep, spare);
+	if (!err && !(status & EXTENT_STATUS_DELAYED))
+		ext4_es_lru_add(inode);
+	return err;
+}
+
+/*
+ * ext4_es_cache_hole() records a hole found in the on-disk map.  Delayed
+ * blocks live in on-disk holes, so the hole is cut short at the first
+ * delayed extent and not recorded at all if @lblk itself is delayed.
+ */
+void ext4_es_cache_hole(struct inode *inode, ext4_lblk_t lblk, ext4_lblk_t len)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status newes, *es, *spare = NULL;
+	ext4_lblk_t end;
+	int err = -ENOENT;
+
+	if (!len)
+		return;
+
+	end = ext4_es_range_end(lblk, len);
+
+	write_lock(&ei->i_es_lock);
+	es = __es_tree_search(&ei->i_es_tree.root, lblk);
+	while (es && es->es_lblk <= end) {
+		if (ext4_es_is_delayed(es)) {
+			if (es->es_lblk <= lblk)
+				goto out;
+			end = es->es_lblk - 1;
+			break;
+		}
+		es = ext4_es_next(es);
+	}
+
+	newes.es_lblk = lblk;
+	newes.es_len = end - lblk + 1;
+	newes.es_pblk = EXTENT_STATUS_HOLE;
+	err = __es_remove_extent(inode, lblk, end, 0, &spare);
+	if (!err)
+		err = __es_insert_extent(inode, &newes, &spare);
+out:
+	write_unlock(&ei->i_es_lock);
+
+	if (!err)
+		ext4_es_lru_add(inode);
+}
+
+static void __ext4_es_remove(struct inode *inode, ext4_lblk_t lblk,
+			     ext4_lblk_t len, int keep_delayed)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status *spare = NULL;
+	ext4_lblk_t end;
+
+	if (!len)
+		return;
+
+	end = ext4_es_range_end(lblk, len);
+
+	write_lock(&ei->i_es_lock);
+	while (__es_remove_extent(inode, lblk, end, keep_delayed, &spare)) {
+		write_unlock(&ei->i_es_lock);
+		spare = kmem_cache_alloc(ext4_es_cachep,
+					 GFP_NOFS | __GFP_NOFAIL);
+		write_lock(&ei->i_es_lock);
+	}
+	write_unlock(&ei->i_es_lock);
+
+	if (spare)
+		kmem_cache_free(ext4_es_cachep, spare);
+}
+
+/*
+ * ext4_es_remove_extent() forgets everything about [lblk, lblk + len),
+ * delayed extents included.  Used once blocks are allocated, truncated or
+ * their delalloc reservation is released.
+ */
+void ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+			   ext4_lblk_t len)
+{
+	__ext4_es_remove(inode, lblk, len, 0);
+}
+
+/*
+ * ext4_es_invalidate() drops the cached on-disk map of [lblk, lblk + len)
+ * after it has been changed, but keeps the delayed extents in the range.
+ */
+void ext4_es_invalidate(struct inode *inode, ext4_lblk_t lblk,
+			ext4_lblk_t len)
+{
+	__ext4_es_remove(inode, lblk, len, 1);
+}
+
+/*
+ * ext4_es_lookup_extent() copies the extent containing @lblk into @es and
+ * returns 1, or returns 0 if the tree knows nothing about @lblk.
+ */
+int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
+			  struct extent_status *es)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_es_tree *tree = &ei->i_es_tree;
+	struct ext4_es_stats *stats = &EXT4_SB(inode->i_sb)->s_es_stats;
+	struct extent_status *es1;
+	int found = 0;
+
+	read_lock(&ei->i_es_lock);
+	es1 = tree->cache_es;
+	if (!es1 || lblk < es1->es_lblk || lblk > ext4_es_end(es1)) {
+		es1 = __es_tree_search(&tree->root, lblk);
+		if (es1 && es1->es_lblk > lblk)
+			es1 = NULL;
+	}
+	if (es1) {
+		tree->cache_es = es1;
+		es->es_lblk = es1->es_lblk;
+		es->es_len = es1->es_len;
+		es->es_pblk = es1->es_pblk;
+		found = 1;
+	}
+	read_unlock(&ei->i_es_lock);
+
+	stats->es_stats_lookups++;
+	if (found)
+		stats->es_stats_cache_hits++;
+	return found;
+}
+
+/*
+ * ext4_es_find_delayed_extent() looks for a delayed extent overlapping
+ * [lblk, end].  On success it is copied into @es and 1 is returned.
+ */
+int ext4_es_find_delayed_extent(struct inode *inode, ext4_lblk_t lblk,
+				ext4_lblk_t end, struct extent_status *es)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status *es1;
+	int found = 0;
+
+	read_lock(&ei->i_es_lock);
+	es1 = __es_tree_search(&ei->i_es_tree.root, lblk);
+	while (es1 && es1->es_lblk <= end) {
+		if (ext4_es_is_delayed(es1)) {
+			es->es_lblk = es1->es_lblk;
+			es->es_len = es1->es_len;
+			es->es_pblk = es1->es_pblk;
+			found = 1;
+			break;
+		}
+		es1 = ext4_es_next(es1);
+	}
+	read_unlock(&ei->i_es_lock);
+
+	return found;
+}
+
+static int ext4_es_reclaim_extents(struct ext4_inode_info *ei, int nr_to_scan)
+{
+	struct inode *inode = &ei->vfs_inode;
+	struct ext4_es_tree *tree = &ei->i_es_tree;
+	struct extent_status *es, *next;
+	int nr_shrunk = 0;
+
+	if (ei->i_es_lru_nr == 0)
+		return 0;
+
+	tree->cache_es = NULL;
+	es = __es_tree_search(&tree->root, 0);
+	while (es && nr_to_scan > 0) {
+		next = ext4_es_next(es);
+		if (!ext4_es_is_delayed(es)) {
+			ext4_es_erase(inode, es);
+			nr_shrunk++;
+			nr_to_scan--;
+		}
+		es = next;
+	}
+	return nr_shrunk;
+}
+
+static int ext4_es_shrink(struct shrinker *shrink, struct shrink_control *sc)
+{
+	struct ext4_sb_info *sbi = container_of(shrink,
+					struct ext4_sb_info, s_es_shrinker);
+	struct ext4_inode_info *ei;
+	struct list_head *cur, *tmp;
+	LIST_HEAD(skipped);
+	int nr_to_scan = sc->nr_to_scan;
+	int shrunk, nr_shrunk = 0;
+
+	if (!nr_to_scan)
+		goto out;
+
+	spin_lock(&sbi->s_es_lru_lock);
+	list_for_each_safe(cur, tmp, &sbi->s_es_lru) {
+		ei = list_entry(cur, struct ext4_inode_info, i_es_lru);
+
+		if (!write_trylock(&ei->i_es_lock)) {
+			list_move_tail(cur, &skipped);
+			continue;
+		}
+		shrunk = ext4_es_reclaim_extents(ei, nr_to_scan);
+		if (ei->i_es_lru_nr == 0)
+			list_del_init(cur);
+		write_unlock(&ei->i_es_lock);
+
+		nr_shrunk += shrunk;
+		nr_to_scan -= shrunk;
+		if (nr_to_scan <= 0)
+			break;
+	}
+	list_splice_tail(&skipped, &sbi->s_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+
+	sbi->s_es_stats.es_stats_shrunk += nr_shrunk;
+out:
+	return percpu_counter_read_positive(&sbi->s_es_stats.es_stats_lru_cnt);
+}
+
+int ext4_es_register_shrinker(struct ext4_sb_info *sbi)
+{
+	int err;
+
+	INIT_LIST_HEAD(&sbi->s_es_lru);
+	spin_lock_init(&sbi->s_es_lru_lock);
+	err = percpu_counter_init(&sbi->s_es_stats.es_stats_lru_cnt, 0);
+	if (err)
+		return err;
+
+	sbi->s_es_shrinker.shrink = ext4_es_shrink;
+	sbi->s_es_shrinker.seeks = DEFAULT_SEEKS;
+	err = register_shrinker(&sbi->s_es_shrinker);
+	if (err)
+		percpu_counter_destroy(&sbi->s_es_stats.es_stats_lru_cnt);
+	return err;
+}
+
+void ext4_es_unregister_shrinker(struct ext4_sb_info *sbi)
+{
+	unregister_shrinker(&sbi->s_es_shrinker);
+	percpu_counter_destroy(&sbi->s_es_stats.es_stats_lru_cnt);
+}
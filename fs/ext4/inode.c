@@ -471,12 +471,33 @@ static void set_buffers_da_mapped(struct inode *inode,
 int ext4_map_blocks(handle_t *handle, struct inode *inode,
 		    struct ext4_map_blocks *map, int flags)
 {
+	struct extent_status es;
+	unsigned int len = map->m_len;
 	int retval;
 
 	map->m_flags = 0;
 	ext_debug("ext4_map_blocks(): inode %lu, flag %d, max_blocks %u,"
 		  "logical block %lu\n", inode->i_ino, flags, map->m_len,
 		  (unsigned long) map->m_lblk);
+
+	/* Look the block up in the extent status tree first */
+	if (ext4_es_lookup_extent(inode, map->m_lblk, &es)) {
+		if (ext4_es_is_written(&es) || ext4_es_is_unwritten(&es)) {
+			map->m_pblk = ext4_es_pblock(&es) +
+					map->m_lblk - es.es_lblk;
+			map->m_flags |= ext4_es_is_written(&es) ?
+					EXT4_MAP_MAPPED : EXT4_MAP_UNWRITTEN;
+			retval = es.es_len - (map->m_lblk - es.es_lblk);
+			if (retval > map->m_len)
+				retval = map->m_len;
+			map->m_len = retval;
+		} else {
+			/* hole, or delayed and not on disk yet */
+			retval = 0;
+		}
+		goto found;
+	}
+
 	/*
 	 * Try to see if we can get the block without requesting a new
 	 * file system block.
@@ -489,8 +510,15 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 		retval = ext4_ind_map_blocks(handle, inode, map, flags &
 					     EXT4_GET_BLOCKS_KEEP_SIZE);
 	}
+	if (retval > 0 &&
+	    map->m_flags & (EXT4_MAP_MAPPED | EXT4_MAP_UNWRITTEN))
+		ext4_es_insert_extent(inode, map->m_lblk, retval, map->m_pblk,
+				      map->m_flags & EXT4_MAP_UNWRITTEN ?
+				      EXTENT_STATUS_UNWRITTEN :
+				      EXTENT_STATUS_WRITTEN);
 	up_read((&EXT4_I(inode)->i_data_sem));
 
+found:
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED) {
 		int ret = check_block_validity(inode, map);
 		if (ret != 0)
@@ -567,6 +595,15 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 			(flags & EXT4_GET_BLOCKS_DELALLOC_RESERVE))
 			ext4_da_update_reserve_space(inode, retval, 1);
 	}
+	/*
+	 * The on-disk map of the range may have changed, drop what the
+	 * extent status tree knew about it.  Delayed extents go away only
+	 * once their blocks have really been allocated.
+	 */
+	ext4_es_invalidate(inode, map->m_lblk, len);
+	if (retval > 0 && flags & EXT4_GET_BLOCKS_DELALLOC_RESERVE)
+		ext4_es_remove_extent(inode, map->m_lblk, retval);
+
 	if (flags & EXT4_GET_BLOCKS_DELALLOC_RESERVE) {
 		ext4_clear_inode_state(inode, EXT4_STATE_DELALLOC_RESERVED);
 
@@ -1233,6 +1270,17 @@ static void ext4_da_page_release_reservation(struct page *page,
 		curr_off = next_off;
 	} while ((bh = bh->b_this_page) != head);
 
+	if (to_release) {
+		ext4_lblk_t lblk, first, nr;
+
+		nr = PAGE_CACHE_SIZE >> inode->i_blkbits;
+		first = (offset + (1 << inode->i_blkbits) - 1) >>
+			inode->i_blkbits;
+		lblk = (page->index << (PAGE_CACHE_SHIFT - inode->i_blkbits)) +
+			first;
+		ext4_es_remove_extent(inode, lblk, nr - first);
+	}
+
 	/* If we have released all the blocks belonging to a cluster, then we
 	 * need to release the reserved space for that cluster. */
 	num_clusters = EXT4_NUM_B2C(sbi, to_release);
@@ -1421,6 +1469,11 @@ static void ext4_da_block_invalidatepages(struct mpage_da_data *mpd)
 
 	index = mpd->first_page;
 	end   = mpd->next_page - 1;
+	/* the delayed blocks of these pages are being thrown away */
+	ext4_es_remove_extent(inode,
+			      index << (PAGE_CACHE_SHIFT - inode->i_blkbits),
+			      (end - index + 1) <<
+			      (PAGE_CACHE_SHIFT - inode->i_blkbits));
 	while (index <= end) {
 		nr_pages = pagevec_lookup(&pvec, mapping, index, PAGEVEC_SIZE);
 		if (nr_pages == 0)
@@ -1719,6 +1772,8 @@ static int ext4_da_map_blocks(struct inode *inode, sector_t iblock,
 		retval = ext4_ind_map_blocks(NULL, inode, map, 0);
 
 	if (retval == 0) {
+		int reserved = 0;
+
 		/*
 		 * XXX: __block_prepare_write() unmaps passed block,
 		 * is it OK?
@@ -1730,6 +1785,15 @@ static int ext4_da_map_blocks(struct inode *inode, sector_t iblock,
 			if (retval)
 				/* not enough space to reserve */
 				goto out_unlock;
+			reserved = 1;
+		}
+
+		retval = ext4_es_insert_extent(inode, iblock, 1, ~0,
+					       EXTENT_STATUS_DELAYED);
+		if (retval) {
+			if (reserved)
+				ext4_da_release_space(inode, 1);
+			goto out_unlock;
 		}
 
 		/* Clear EXT4_MAP_FROM_CLUSTER flag since its purpose is served
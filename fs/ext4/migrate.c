@@ -343,6 +343,7 @@ static int ext4_ext_swap_inode_data(handle_t *handle, struct inode *inode,
 		goto err_out;
 	} else
 		ext4_clear_inode_state(inode, EXT4_STATE_EXT_MIGRATE);
+	ext4_es_invalidate(inode, 0, EXT_MAX_BLOCKS);
 	/*
 	 * We have the extent map build with the tmp inode.
 	 * Now copy the i_data across
@@ -763,6 +763,8 @@ out:
 
 	ext4_ext_invalidate_cache(orig_inode);
 	ext4_ext_invalidate_cache(donor_inode);
+	ext4_es_invalidate(orig_inode, 0, EXT_MAX_BLOCKS);
+	ext4_es_invalidate(donor_inode, 0, EXT_MAX_BLOCKS);
 
 	double_up_write_data_sem(orig_inode, donor_inode);
 
@@ -171,6 +171,9 @@ int inode_init_always(struct super_block *sb, struct inode *inode)
 #ifdef CONFIG_SDP
 	mapping->userid = 0;
 #endif
+#ifdef CONFIG_READAHEAD_HISTORY
+	memset(&mapping->ra_history, 0, sizeof(mapping->ra_history));
+#endif
 
 	/*
 	 * If the block_device provides a backing_dev_info for client
@@ -500,6 +503,11 @@ void end_writeback(struct inode *inode)
 	spin_lock_irq(&inode->i_data.tree_lock);
 	BUG_ON(inode->i_data.nrpages);
 	spin_unlock_irq(&inode->i_data.tree_lock);
+	/*
+	 * With the pages gone reclaim cannot add shadow entries anymore,
+	 * but ->evict_inode need not have truncated the ones left so far.
+	 */
+	clear_shadow_entries(&inode->i_data, 0, ~0UL);
 	BUG_ON(!list_empty(&inode->i_data.private_list));
 	BUG_ON(!(inode->i_state & I_FREEING));
 	BUG_ON(inode->i_state & I_CLEAR);
@@ -11,6 +11,7 @@
 #include <linux/rmap.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
+#include <linux/mm_inline.h>
 
 #include <asm/elf.h>
 #include <asm/uaccess.h>
@@ -1131,6 +1132,215 @@ const struct file_operations proc_pagemap_operations = {
 };
 #endif /* CONFIG_PROC_PAGE_MONITOR */
 
+#ifdef CONFIG_PROCESS_RECLAIM
+enum reclaim_type {
+	RECLAIM_FILE,
+	RECLAIM_ANON,
+	RECLAIM_ALL,
+};
+
+/* Result of the last write, read back through the same open file */
+struct reclaim_stats {
+	unsigned long nr_scanned;
+	unsigned long nr_reclaimed;
+};
+
+struct reclaim_walk {
+	struct vm_area_struct *vma;
+	enum reclaim_type type;
+	struct reclaim_stats stats;
+};
+
+static int reclaim_pte_range(pmd_t *pmd, unsigned long addr,
+			     unsigned long end, struct mm_walk *walk)
+{
+	struct reclaim_walk *rw = walk->private;
+	struct vm_area_struct *vma = rw->vma;
+	pte_t *orig_pte, *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+	LIST_HEAD(page_list);
+	int isolated = 0;
+
+	split_huge_page_pmd(walk->mm, pmd);
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (!pte_present(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		if (rw->type == RECLAIM_FILE && !page_is_file_cache(page))
+			continue;
+		if (rw->type == RECLAIM_ANON && page_is_file_cache(page))
+			continue;
+
+		/* Pages shared with other processes are not ours to push out */
+		if (page_mapcount(page) != 1)
+			continue;
+
+		if (isolate_lru_page(page))
+			continue;
+
+		list_add(&page->lru, &page_list);
+		isolated++;
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	if (isolated)
+		rw->stats.nr_reclaimed +=
+			reclaim_pages_from_list(&page_list,
+						&rw->stats.nr_scanned);
+	cond_resched();
+	return 0;
+}
+
+/*
+ * Accepts "file", "anon" or "all", optionally followed by "<start> <size>"
+ * to limit reclaim to that part of the address space.
+ */
+static int reclaim_parse(char *buf, enum reclaim_type *type,
+			 unsigned long *start, unsigned long *end)
+{
+	char *sptr = strstrip(buf);
+	char *token;
+	unsigned long size;
+
+	token = strsep(&sptr, " ");
+	if (!token)
+		return -EINVAL;
+	if (!strcmp(token, "file"))
+		*type = RECLAIM_FILE;
+	else if (!strcmp(token, "anon"))
+		*type = RECLAIM_ANON;
+	else if (!strcmp(token, "all"))
+		*type = RECLAIM_ALL;
+	else
+		return -EINVAL;
+
+	*start = 0;
+	*end = TASK_SIZE;
+	if (!sptr)
+		return 0;
+
+	token = strsep(&sptr, " ");
+	if (!token || kstrtoul(token, 0, start))
+		return -EINVAL;
+	token = strsep(&sptr, " ");
+	if (!token || kstrtoul(token, 0, &size) || sptr)
+		return -EINVAL;
+	if (!size || *start >= TASK_SIZE || size > TASK_SIZE - *start)
+		return -EINVAL;
+
+	*end = PAGE_ALIGN(*start + size);
+	*start &= PAGE_MASK;
+	return 0;
+}
+
+static ssize_t reclaim_write(struct file *file, const char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	struct reclaim_stats *last = file->private_data;
+	struct task_struct *task;
+	char buffer[64];
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	struct reclaim_walk rw = { };
+	unsigned long start, end;
+	int rv;
+
+	memset(buffer, 0, sizeof(buffer));
+	if (count > sizeof(buffer) - 1)
+		count = sizeof(buffer) - 1;
+	if (copy_from_user(buffer, buf, count))
+		return -EFAULT;
+	rv = reclaim_parse(buffer, &rw.type, &start, &end);
+	if (rv < 0)
+		return rv;
+
+	task = get_proc_task(file->f_path.dentry->d_inode);
+	if (!task)
+		return -ESRCH;
+	mm = get_task_mm(task);
+	if (mm) {
+		struct mm_walk reclaim_walk = {
+			.pmd_entry = reclaim_pte_range,
+			.mm = mm,
+			.private = &rw,
+		};
+
+		down_read(&mm->mmap_sem);
+		for (vma = find_vma(mm, start); vma; vma = vma->vm_next) {
+			if (vma->vm_start >= end)
+				break;
+			if (is_vm_hugetlb_page(vma))
+				continue;
+			if (vma->vm_flags & (VM_LOCKED | VM_PFNMAP))
+				continue;
+			if (rw.type == RECLAIM_ANON && !vma->anon_vma)
+				continue;
+			if (rw.type == RECLAIM_FILE && !vma->vm_file)
+				continue;
+			if (fatal_signal_pending(current))
+				break;
+
+			rw.vma = vma;
+			walk_page_range(max(vma->vm_start, start),
+					min(vma->vm_end, end), &reclaim_walk);
+		}
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+	put_task_struct(task);
+
+	/* Rewind, so that a read after each write reports on that write */
+	*last = rw.stats;
+	*ppos = 0;
+	return count;
+}
+
+static ssize_t reclaim_read(struct file *file, char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	struct reclaim_stats *last = file->private_data;
+	char buffer[64];
+	int len;
+
+	len = snprintf(buffer, sizeof(buffer), "scanned %lu\nreclaimed %lu\n",
+		       last->nr_scanned, last->nr_reclaimed);
+	return simple_read_from_buffer(buf, count, ppos, buffer, len);
+}
+
+static int reclaim_open(struct inode *inode, struct file *file)
+{
+	file->private_data = kzalloc(sizeof(struct reclaim_stats),
+				     GFP_KERNEL);
+	if (!file->private_data)
+		return -ENOMEM;
+	return 0;
+}
+
+static int reclaim_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+const struct file_operations proc_reclaim_operations = {
+	.open		= reclaim_open,
+	.read		= reclaim_read,
+	.write		= reclaim_write,
+	.release	= reclaim_release,
+	.llseek		= noop_llseek,
+};
+#endif /* CONFIG_PROCESS_RECLAIM */
+
 #ifdef CONFIG_NUMA
 
 struct numa_maps {
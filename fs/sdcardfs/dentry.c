@@ -21,6 +21,64 @@
 #include "sdcardfs.h"
 #include "linux/ctype.h"
 
+/*
+ * RCU-walk flavour of sdcardfs_d_revalidate(): no references are taken
+ * and nothing sleeps.  Only the common case of an unchanged, up to date
+ * dentry is answered here; anything that would need to drop the dentry or
+ * re-derive its permissions is left to ref-walk by returning -ECHILD.
+ * The private data, the inode and the lower dentries are all freed after
+ * an RCU grace period, so they stay readable for the duration of the walk.
+ */
+static int sdcardfs_d_revalidate_rcu(struct dentry *dentry)
+{
+	struct sdcardfs_dentry_info *di, *parent_di;
+	struct dentry *parent, *lower_dentry, *lower_parent;
+	struct inode *inode;
+	unsigned seq;
+	int err = -ECHILD;
+
+	if (IS_ROOT(dentry))
+		return 1;
+
+	parent = ACCESS_ONCE(dentry->d_parent);
+	di = ACCESS_ONCE(dentry->d_fsdata);
+	parent_di = ACCESS_ONCE(parent->d_fsdata);
+	if (!di || !parent_di)
+		return -ECHILD;
+
+	inode = ACCESS_ONCE(dentry->d_inode);
+	if (inode && derived_permission_stale(inode))
+		return -ECHILD;
+
+	spin_lock(&di->lock);
+	/* obb dentries need d_path() to check their base, see below */
+	if (di->orig_path.dentry) {
+		spin_unlock(&di->lock);
+		return -ECHILD;
+	}
+	lower_dentry = di->lower_path.dentry;
+	spin_unlock(&di->lock);
+
+	spin_lock(&parent_di->lock);
+	lower_parent = parent_di->lower_path.dentry;
+	spin_unlock(&parent_di->lock);
+
+	if (!lower_dentry || !lower_parent)
+		return -ECHILD;
+
+	seq = read_seqcount_begin(&lower_dentry->d_seq);
+	if (d_unhashed(lower_dentry) || lower_dentry->d_parent != lower_parent)
+		goto out;
+	if (dentry->d_name.len != lower_dentry->d_name.len ||
+	    strncasecmp(dentry->d_name.name, lower_dentry->d_name.name,
+			dentry->d_name.len) != 0)
+		goto out;
+	if (!read_seqcount_retry(&lower_dentry->d_seq, seq))
+		err = 1;
+out:
+	return err;
+}
+
 /*
  * returns: -ERRNO if error (returned to user)
  *          0: tell VFS to invalidate dentry
@@ -36,7 +94,7 @@ static int sdcardfs_d_revalidate(struct dentry *dentry, struct nameidata *nd)
 	struct dentry *lower_dentry = NULL;
 
 	if (nd && nd->flags & LOOKUP_RCU)
-		return -ECHILD;
+		return sdcardfs_d_revalidate_rcu(dentry);
 
 	spin_lock(&dentry->d_lock);
 	if (IS_ROOT(dentry)) {
@@ -105,6 +163,10 @@ static int sdcardfs_d_revalidate(struct dentry *dentry, struct nameidata *nd)
 		spin_unlock(&lower_dentry->d_lock);
 	}
 
+	/* catch up with package list changes since the last derivation */
+	if (err == 1 && dentry->d_inode)
+		refresh_derived_permission(dentry);
+
 out:
 	dput(parent_dentry);
 	dput(lower_cur_parent_dentry);
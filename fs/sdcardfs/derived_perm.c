@@ -46,6 +46,44 @@ void setup_derived_state(struct inode *inode, perm_t perm,
 	info->under_android = under_android;
 }
 
+/*
+ * Package directories are revalidated far more often than the package
+ * list changes, so remember the appid on the inode and only go back to
+ * the package table once its generation has moved on.
+ */
+static appid_t get_cached_appid(struct sdcardfs_sb_info *sbi,
+				struct dentry *dentry)
+{
+	struct inode *inode = dentry->d_inode;
+	struct sdcardfs_inode_info *info = SDCARDFS_I(inode);
+	unsigned int gen = get_packagelist_generation(sbi->pkgl_id);
+	appid_t appid;
+
+	spin_lock(&inode->i_lock);
+	if (info->d_appid_gen == gen) {
+		appid = info->d_appid;
+		spin_unlock(&inode->i_lock);
+		return appid;
+	}
+	spin_unlock(&inode->i_lock);
+
+	appid = get_appid(sbi->pkgl_id, dentry->d_name.name);
+
+	spin_lock(&inode->i_lock);
+	info->d_appid = appid;
+	info->d_appid_gen = gen;
+	spin_unlock(&inode->i_lock);
+	return appid;
+}
+
+/* the cached appid belongs to the old name after a rename */
+void invalidate_cached_appid(struct inode *inode)
+{
+	spin_lock(&inode->i_lock);
+	SDCARDFS_I(inode)->d_appid_gen = 0;
+	spin_unlock(&inode->i_lock);
+}
+
 void get_derived_permission(struct dentry *parent, struct dentry *dentry)
 {
 	struct sdcardfs_sb_info *sbi = SDCARDFS_SB(dentry->d_sb);
@@ -54,6 +92,7 @@ void get_derived_permission(struct dentry *parent, struct dentry *dentry)
 #ifdef CONFIG_SDP
 	struct sdcardfs_dentry_info *parent_dinfo = SDCARDFS_D(parent);
 #endif
+	unsigned int gen = get_packagelist_generation(sbi->pkgl_id);
 	appid_t appid;
 
 	/* By default, each inode inherits from its parent. 
@@ -115,7 +154,7 @@ void get_derived_permission(struct dentry *parent, struct dentry *dentry)
 		case PERM_ANDROID_DATA:
 		case PERM_ANDROID_OBB:
 		case PERM_ANDROID_MEDIA:
-			appid = get_appid(sbi->pkgl_id, dentry->d_name.name);
+			appid = get_cached_appid(sbi, dentry);
 			if (appid != 0) {
 				info->d_uid = multiuser_get_uid(parent_info->userid, appid);
 			}
@@ -150,7 +189,7 @@ void get_derived_permission(struct dentry *parent, struct dentry *dentry)
 		break;
 
 		case PERM_ANDROID_KNOX_DATA:
-			appid = get_appid(sbi->pkgl_id, dentry->d_name.name);
+			appid = get_cached_appid(sbi, dentry);
 			info->perm = PERM_ANDROID_KNOX_PACKAGE_DATA;
 		if (appid != 0) {
 			info->d_uid = multiuser_get_uid(parent_info->userid, appid);
@@ -163,8 +202,49 @@ void get_derived_permission(struct dentry *parent, struct dentry *dentry)
 		break;
 
 	}
+	info->d_perm_gen = gen;
 } 
 
+/*
+ * Derived state is not recomputed eagerly when packages.list changes.
+ * Instead, every derivation records the package list generation it used,
+ * and d_revalidate() re-derives dentries whose generation is behind.
+ */
+int derived_permission_stale(struct inode *inode)
+{
+	struct sdcardfs_sb_info *sbi = SDCARDFS_SB(inode->i_sb);
+
+	return ACCESS_ONCE(SDCARDFS_I(inode)->d_perm_gen) !=
+		get_packagelist_generation(sbi->pkgl_id);
+}
+
+/*
+ * Bring the derived state of a dentry up to date.  Ancestors are fixed
+ * first, since the state of each directory is inherited from its parent;
+ * this is done iteratively to keep stack usage flat on deep trees.
+ */
+void refresh_derived_permission(struct dentry *dentry)
+{
+	struct dentry *cur, *parent;
+
+	while (!IS_ROOT(dentry) && derived_permission_stale(dentry->d_inode)) {
+		/* find the topmost ancestor that is still stale */
+		cur = dget(dentry);
+		for (;;) {
+			parent = dget_parent(cur);
+			if (IS_ROOT(parent) ||
+			    !derived_permission_stale(parent->d_inode))
+				break;
+			dput(cur);
+			cur = parent;
+		}
+		get_derived_permission(parent, cur);
+		fix_derived_permission(cur->d_inode);
+		dput(parent);
+		dput(cur);
+	}
+}
+
 /* set vfs_inode from sdcardfs_inode */
 void fix_derived_permission(struct inode *inode) {
 	struct sdcardfs_inode_info *info = SDCARDFS_I(inode);
@@ -567,6 +567,8 @@ static int sdcardfs_rename(struct inode *old_dir, struct dentry *old_dentry,
 			dput(new_parent);
 		}
 	}
+	if (old_dentry->d_inode)
+		invalidate_cached_appid(old_dentry->d_inode);
 
 out_err:
 	mnt_drop_write(lower_new_path.mnt);
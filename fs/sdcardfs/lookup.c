@@ -36,16 +36,30 @@ int sdcardfs_init_dentry_cache(void)
 
 void sdcardfs_destroy_dentry_cache(void)
 {
+	/* wait for free_dentry_private_data() callbacks */
+	rcu_barrier();
 	if (sdcardfs_dentry_cachep)
 		kmem_cache_destroy(sdcardfs_dentry_cachep);
 }
 
+static void sdcardfs_dentry_info_callback(struct rcu_head *head)
+{
+	struct sdcardfs_dentry_info *info =
+		container_of(head, struct sdcardfs_dentry_info, rcu);
+
+	kmem_cache_free(sdcardfs_dentry_cachep, info);
+}
+
 void free_dentry_private_data(struct dentry *dentry)
 {
+	struct sdcardfs_dentry_info *info;
+
 	if (!dentry || !dentry->d_fsdata)
 		return;
-	kmem_cache_free(sdcardfs_dentry_cachep, dentry->d_fsdata);
+	info = dentry->d_fsdata;
 	dentry->d_fsdata = NULL;
+	/* sdcardfs_d_revalidate_rcu() may still be looking at it */
+	call_rcu(&info->rcu, sdcardfs_dentry_info_callback);
 }
 
 /* allocate new dentry private data */
@@ -24,6 +24,7 @@
 #include <linux/kthread.h>
 #include <linux/inotify.h>
 #include <linux/delay.h>
+#include <linux/ctype.h>
 
 #define STRING_BUF_SIZE		(512)
 
@@ -31,13 +32,25 @@ struct hashtable_entry {
         struct hlist_node hlist;
         void *key;
 	int value;
+	/* last list generation this package was seen in */
+	unsigned int gen;
+	struct rcu_head rcu;
 };
 
+/*
+ * get_appid() walks package_to_appid under rcu_read_lock() only.  The
+ * reader thread is the only writer; it holds hashtable_lock, and never
+ * changes an entry in place but swaps in a new one with hlist_replace_rcu().
+ * generation is bumped after every reload that changed the table, so that
+ * callers can cache appids and notice when they have become stale.
+ */
 struct packagelist_data {
 	DECLARE_HASHTABLE(package_to_appid,8);
 	struct mutex hashtable_lock;
+	unsigned int generation;
+	unsigned int read_gen;
 	struct task_struct *thread_id;
-	char read_buf[STRING_BUF_SIZE];
+	char read_buf[STRING_BUF_SIZE + 1];
 	char event_buf[STRING_BUF_SIZE];
 	char app_name_buf[STRING_BUF_SIZE];
 	char gids_buf[STRING_BUF_SIZE];
@@ -50,13 +63,13 @@ static const char* const kpackageslist_file = "/data/system/packages.list";
 /* Supplementary groups to execute with */
 static const gid_t kgroups[1] = { AID_PACKAGE_INFO };
 
+/* names are compared with strcasecmp(), so they must hash the same way */
 static unsigned int str_hash(void *key) {
-	int i;
 	unsigned int h = strlen(key);
 	char *data = (char *)key;
 
-	for (i = 0; i < strlen(key); i++) {
-		h = h * 31 + *data;
+	while (*data) {
+		h = h * 31 + tolower(*data);
 		data++;
 	}
 	return h;
@@ -71,21 +84,32 @@ appid_t get_appid(void *pkgl_id, const char *app_name)
 	appid_t ret_id;
 
 	//printk(KERN_INFO "sdcardfs: %s: %s, %u\n", __func__, (char *)app_name, hash);
-	mutex_lock(&pkgl_dat->hashtable_lock);
-	hash_for_each_possible(pkgl_dat->package_to_appid, hash_cur, hlist, hash, h_n) {
+	rcu_read_lock();
+	hash_for_each_possible_rcu(pkgl_dat->package_to_appid, hash_cur, hlist, hash, h_n) {
 		//printk(KERN_INFO "sdcardfs: %s: %s\n", __func__, (char *)hash_cur->key);
 		if (!strcasecmp(app_name, hash_cur->key)) {
 			ret_id = (appid_t)hash_cur->value;
-			mutex_unlock(&pkgl_dat->hashtable_lock);
+			rcu_read_unlock();
 			//printk(KERN_INFO "=> app_id: %d\n", (int)ret_id);
 			return ret_id;
 		}
 	}
-	mutex_unlock(&pkgl_dat->hashtable_lock);
+	rcu_read_unlock();
 	//printk(KERN_INFO "=> app_id: %d\n", 0);
 	return 0;
 }
 
+/* Generation of the package table; changes whenever an appid may have. */
+unsigned int get_packagelist_generation(void *pkgl_id)
+{
+	struct packagelist_data *pkgl_dat = (struct packagelist_data *)pkgl_id;
+	unsigned int gen = ACCESS_ONCE(pkgl_dat->generation);
+
+	/* pairs with the smp_wmb() in read_package_list() */
+	smp_rmb();
+	return gen;
+}
+
 /* Kernel has already enforced everything we returned through
  * derive_permissions_locked(), so this is used to lock down access
  * even further, such as enforcing that apps hold sdcard_rw. */
@@ -122,6 +146,30 @@ int open_flags_to_access_mode(int open_flags) {
 	}
 }
 
+static void free_hashtable_entry_rcu(struct rcu_head *head) {
+	struct hashtable_entry *h_entry =
+		container_of(head, struct hashtable_entry, rcu);
+
+	kfree(h_entry->key);
+	kmem_cache_free(hashtable_entry_cachep, h_entry);
+}
+
+static struct hashtable_entry *alloc_hashtable_entry(void *key, int value) {
+	struct hashtable_entry *new_entry;
+
+	new_entry = kmem_cache_alloc(hashtable_entry_cachep, GFP_KERNEL);
+	if (!new_entry)
+		return NULL;
+	new_entry->key = kstrdup(key, GFP_KERNEL);
+	if (!new_entry->key) {
+		kmem_cache_free(hashtable_entry_cachep, new_entry);
+		return NULL;
+	}
+	new_entry->value = value;
+	return new_entry;
+}
+
+/* returns 1 if the table changed, 0 if not, or -ENOMEM */
 static int insert_str_to_int(struct packagelist_data *pkgl_dat, void *key, int value) {
 	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
@@ -131,23 +179,50 @@ static int insert_str_to_int(struct packagelist_data *pkgl_dat, void *key, int v
 	//printk(KERN_INFO "sdcardfs: %s: %s: %d, %u\n", __func__, (char *)key, value, hash);
 	hash_for_each_possible(pkgl_dat->package_to_appid, hash_cur, hlist, hash, h_n) {
 		if (!strcasecmp(key, hash_cur->key)) {
-			hash_cur->value = value;
-			return 0;
+			if (hash_cur->value == value) {
+				hash_cur->gen = pkgl_dat->read_gen;
+				return 0;
+			}
+			/* readers may still hold hash_cur; swap it out */
+			new_entry = alloc_hashtable_entry(key, value);
+			if (!new_entry)
+				return -ENOMEM;
+			new_entry->gen = pkgl_dat->read_gen;
+			hlist_replace_rcu(&hash_cur->hlist, &new_entry->hlist);
+			call_rcu(&hash_cur->rcu, free_hashtable_entry_rcu);
+			return 1;
 		}
 	}
-	new_entry = kmem_cache_alloc(hashtable_entry_cachep, GFP_KERNEL);
+	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	new_entry->key = kstrdup(key, GFP_KERNEL);
-	new_entry->value = value;
-	hash_add(pkgl_dat->package_to_appid, &new_entry->hlist, hash);
-	return 0;
+	new_entry->gen = pkgl_dat->read_gen;
+	hash_add_rcu(pkgl_dat->package_to_appid, &new_entry->hlist, hash);
+	return 1;
 }
 
 static void remove_str_to_int(struct hashtable_entry *h_entry) {
 	//printk(KERN_INFO "sdcardfs: %s: %s: %d\n", __func__, (char *)h_entry->key, h_entry->value);
-	kfree(h_entry->key);
-	kmem_cache_free(hashtable_entry_cachep, h_entry);
+	hash_del_rcu(&h_entry->hlist);
+	call_rcu(&h_entry->rcu, free_hashtable_entry_rcu);
+}
+
+/* drop the packages that were not in the list just read */
+static int remove_stale_hashentrys(struct packagelist_data *pkgl_dat)
+{
+	struct hashtable_entry *hash_cur;
+	struct hlist_node *h_n;
+	struct hlist_node *h_t;
+	int i;
+	int changed = 0;
+
+	hash_for_each_safe(pkgl_dat->package_to_appid, i, h_t, hash_cur, hlist, h_n) {
+		if (hash_cur->gen != pkgl_dat->read_gen) {
+			remove_str_to_int(hash_cur);
+			changed = 1;
+		}
+	}
+	return changed;
 }
 
 /*static void remove_int_to_null(struct hashtable_entry *h_entry) {
@@ -168,17 +243,36 @@ static void remove_all_hashentrys(struct packagelist_data *pkgl_dat)
 	hash_init(pkgl_dat->package_to_appid);
 }
 
+static int parse_package_line(struct packagelist_data *pkgl_dat, char *line) {
+	int appid;
+
+	if (sscanf(line, "%s %d %*d %*s %*s %s",
+			pkgl_dat->app_name_buf, &appid,
+			pkgl_dat->gids_buf) != 3)
+		return 0;
+
+	return insert_str_to_int(pkgl_dat, pkgl_dat->app_name_buf, appid);
+}
+
+/*
+ * Merge the current packages.list into the table.  Entries that did not
+ * change are left alone, so installing one package only costs a re-parse
+ * and a single insertion instead of rebuilding every entry.
+ */
 static int read_package_list(struct packagelist_data *pkgl_dat) {
-	int ret;
+	char *buf = pkgl_dat->read_buf;
+	char *line, *eol;
+	bool skip_line = false;
+	int changed = 0;
+	int ret = 0;
 	int fd;
+	int len = 0;
 	int read_amount;
 
 	printk(KERN_INFO "sdcardfs: read_package_list\n");
 
 	mutex_lock(&pkgl_dat->hashtable_lock);
 
-	remove_all_hashentrys(pkgl_dat);
-
 	fd = sys_open(kpackageslist_file, O_RDONLY, 0);
 	if (fd < 0) {
 		printk(KERN_ERR "sdcardfs: failed to open package list\n");
@@ -186,38 +280,63 @@ static int read_package_list(struct packagelist_data *pkgl_dat) {
 		return fd;
 	}
 
-	while ((read_amount = sys_read(fd, pkgl_dat->read_buf,
-					sizeof(pkgl_dat->read_buf))) > 0) {
-		int appid;
-		int one_line_len = 0;
-		int additional_read;
-	
-		while (one_line_len < read_amount) {
-			if (pkgl_dat->read_buf[one_line_len] == '\n') {
-				one_line_len++;
-				break;
+	pkgl_dat->read_gen++;
+
+	while ((read_amount = sys_read(fd, buf + len,
+					STRING_BUF_SIZE - len)) > 0) {
+		len += read_amount;
+		buf[len] = '\0';
+
+		line = buf;
+		while ((eol = strchr(line, '\n'))) {
+			*eol = '\0';
+			if (!skip_line) {
+				ret = parse_package_line(pkgl_dat, line);
+				if (ret < 0)
+					goto out;
+				changed |= ret;
 			}
-			one_line_len++;
+			skip_line = false;
+			line = eol + 1;
 		}
-		additional_read = read_amount - one_line_len;
-		if (additional_read > 0)
-			sys_lseek(fd, -additional_read, SEEK_CUR);	
-
-		if (sscanf(pkgl_dat->read_buf, "%s %d %*d %*s %*s %s",
-				pkgl_dat->app_name_buf, &appid,
-				pkgl_dat->gids_buf) == 3) {
-			ret = insert_str_to_int(pkgl_dat, pkgl_dat->app_name_buf, appid);
-			if (ret) {
-				sys_close(fd);
-				mutex_unlock(&pkgl_dat->hashtable_lock);
-				return ret;
+
+		len -= line - buf;
+		if (len == STRING_BUF_SIZE) {
+			/* overlong line: the fields we need are at its head */
+			if (!skip_line) {
+				ret = parse_package_line(pkgl_dat, buf);
+				if (ret < 0)
+					goto out;
+				changed |= ret;
 			}
+			skip_line = true;
+			len = 0;
+		} else {
+			memmove(buf, line, len);
 		}
 	}
 
+	if (len && !skip_line) {
+		buf[len] = '\0';
+		ret = parse_package_line(pkgl_dat, buf);
+		if (ret < 0)
+			goto out;
+		changed |= ret;
+	}
+
+	/* only sweep out removed packages once the whole file was read */
+	if (read_amount == 0)
+		changed |= remove_stale_hashentrys(pkgl_dat);
+	ret = 0;
+out:
+	if (changed) {
+		/* publish the table changes before the new generation */
+		smp_wmb();
+		pkgl_dat->generation++;
+	}
 	sys_close(fd);
 	mutex_unlock(&pkgl_dat->hashtable_lock);
-	return 0;
+	return ret;
 }
 
 static int packagelist_reader(void *thread_data)
@@ -315,6 +434,8 @@ void * packagelist_create(void)
 
 	mutex_init(&pkgl_dat->hashtable_lock);
 	hash_init(pkgl_dat->package_to_appid);
+	/* inodes start with a zero cached generation, i.e. never valid */
+	pkgl_dat->generation = 1;
 
 	packagelist_thread = kthread_run(packagelist_reader, (void *)pkgl_dat, "pkgld");
 	if (IS_ERR(packagelist_thread)) {
@@ -357,6 +478,8 @@ int packagelist_init(void)
 
 void packagelist_exit(void)
 {
+	/* wait for the entries freed by call_rcu() */
+	rcu_barrier();
 	if (hashtable_entry_cachep)
 		kmem_cache_destroy(hashtable_entry_cachep);
 }
@@ -200,6 +200,12 @@ struct sdcardfs_inode_info {
 	uid_t d_uid;
 	gid_t d_gid;
 	bool under_android;
+	/* appid of a package directory, valid while d_appid_gen matches
+	 * the package list generation; both protected by i_lock */
+	appid_t d_appid;
+	unsigned int d_appid_gen;
+	/* package list generation the derived state was computed for */
+	unsigned int d_perm_gen;
 
 	struct inode vfs_inode;
 };
@@ -209,6 +215,7 @@ struct sdcardfs_dentry_info {
 	spinlock_t lock;	/* protects lower_path */
 	struct path lower_path;
 	struct path orig_path;
+	struct rcu_head rcu;	/* RCU-walk may still look at us */
 #ifdef CONFIG_SDP
 	int under_knox;
 	int userid;
@@ -405,6 +412,7 @@ static inline void sdcardfs_put_real_lower(const struct dentry *dent,
 
 /* for packagelist.c */
 extern appid_t get_appid(void *pkgl_id, const char *app_name);
+extern unsigned int get_packagelist_generation(void *pkgl_id);
 extern int check_caller_access_to_name(struct inode *parent_node, const char* name);
 extern int open_flags_to_access_mode(int open_flags);
 extern void *packagelist_create(void);
@@ -418,6 +426,9 @@ extern void setup_derived_state(struct inode *inode, perm_t perm,
 extern void get_derived_permission(struct dentry *parent, struct dentry *dentry);
 extern void fix_derived_permission(struct inode *inode);
 extern void update_derived_permission(struct dentry *dentry);
+extern void invalidate_cached_appid(struct inode *inode);
+extern int derived_permission_stale(struct inode *inode);
+extern void refresh_derived_permission(struct dentry *dentry);
 extern int need_graft_path(struct dentry *dentry);
 extern int is_base_obbpath(struct dentry *dentry);
 extern int is_obbpath_invalid(struct dentry *dentry);
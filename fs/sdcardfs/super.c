@@ -155,11 +155,19 @@ static struct inode *sdcardfs_alloc_inode(struct super_block *sb)
 	return &i->vfs_inode;
 }
 
-static void sdcardfs_destroy_inode(struct inode *inode)
+static void sdcardfs_i_callback(struct rcu_head *head)
 {
+	struct inode *inode = container_of(head, struct inode, i_rcu);
+
 	kmem_cache_free(sdcardfs_inode_cachep, SDCARDFS_I(inode));
 }
 
+/* RCU-walk looks at our inodes without holding a reference */
+static void sdcardfs_destroy_inode(struct inode *inode)
+{
+	call_rcu(&inode->i_rcu, sdcardfs_i_callback);
+}
+
 /* sdcardfs inode cache constructor */
 static void init_once(void *obj)
 {
@@ -184,6 +192,8 @@ int sdcardfs_init_inode_cache(void)
 /* sdcardfs inode cache destructor */
 void sdcardfs_destroy_inode_cache(void)
 {
+	/* make sure all delayed inode frees have run */
+	rcu_barrier();
 	if (sdcardfs_inode_cachep)
 		kmem_cache_destroy(sdcardfs_inode_cachep);
 }
@@ -40,6 +40,12 @@ static const struct squashfs_decompressor squashfs_lzma_unsupported_comp_ops = {
 	NULL, NULL, NULL, LZMA_COMPRESSION, "lzma", 0
 };
 
+#ifndef CONFIG_SQUASHFS_LZ4
+static const struct squashfs_decompressor squashfs_lz4_comp_ops = {
+	NULL, NULL, NULL, LZ4_COMPRESSION, "lz4", 0
+};
+#endif
+
 #ifndef CONFIG_SQUASHFS_LZO
 static const struct squashfs_decompressor squashfs_lzo_comp_ops = {
 	NULL, NULL, NULL, LZO_COMPRESSION, "lzo", 0
@@ -66,6 +72,7 @@ static const struct squashfs_decompressor *decompressor[] = {
 	&squashfs_zlib_comp_ops,
 	&squashfs_lzo_comp_ops,
 	&squashfs_xz_comp_ops,
+	&squashfs_lz4_comp_ops,
 	&squashfs_lzma_unsupported_comp_ops,
 	&squashfs_unknown_comp_ops
 };
@@ -83,7 +90,7 @@ const struct squashfs_decompressor *squashfs_lookup_decompressor(int id)
 }
 
 
-void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
+void *squashfs_decompressor_setup(struct super_block *sb, unsigned short flags)
 {
 	struct squashfs_sb_info *msblk = sb->s_fs_info;
 	void *strm, *buffer = NULL;
@@ -107,7 +114,7 @@ void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
 		}
 	}
 
-	strm = msblk->decompressor->init(msblk, buffer, length);
+	strm = squashfs_decompressor_create(msblk, buffer, length);
 
 finished:
 	kfree(buffer);
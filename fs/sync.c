@@ -181,6 +181,10 @@ int vfs_fsync_range(struct file *file, loff_t start, loff_t end, int datasync)
 #endif
 	if (!file->f_op || !file->f_op->fsync)
 		return -EINVAL;
+#ifdef CONFIG_DYNAMIC_FSYNC
+	if (dyn_fsync_group_commit_us)
+		return dyn_fsync_group_commit(file, start, end, datasync);
+#endif
 	return file->f_op->fsync(file, start, end, datasync);
 #ifdef CONFIG_DYNAMIC_FSYNC
 	}
@@ -117,6 +117,7 @@ struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 				       unsigned int order);
 bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 				 int count);
+void dma_contiguous_prepare(struct device *dev, int count, unsigned int align);
 
 #else
 
@@ -146,6 +147,11 @@ bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 }
 
 
+static inline
+void dma_contiguous_prepare(struct device *dev, int count, unsigned int align)
+{
+}
+
 static inline phys_addr_t cma_get_base(struct device *dev)
 {
 	return 0;
@@ -7,8 +7,18 @@
 
 #define DYN_FSYNC_ACTIVE_DEFAULT false
 #define DYN_FSYNC_VERSION_MAJOR 2
-#define DYN_FSYNC_VERSION_MINOR 0
+#define DYN_FSYNC_VERSION_MINOR 1
+
+/* group commit window in microseconds, 0 disables group commit */
+#define DYN_FSYNC_GROUP_COMMIT_US_DEFAULT 0
+#define DYN_FSYNC_GROUP_COMMIT_US_MAX 10000
+
+struct file;
 
 extern bool suspend_active;
 extern bool dyn_fsync_active;
+extern unsigned int dyn_fsync_group_commit_us;
+
+extern int dyn_fsync_group_commit(struct file *file, loff_t start, loff_t end,
+		int datasync);
 
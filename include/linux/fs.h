@@ -672,6 +672,20 @@ int pagecache_write_end(struct file *, struct address_space *mapping,
 				struct page *page, void *fsdata);
 
 struct backing_dev_info;
+#ifdef CONFIG_READAHEAD_HISTORY
+/*
+ * How readahead has fared on a file, kept with its inode across opens and
+ * lost when the inode is evicted.  Updated without locking and halved as
+ * the counters fill up, so only recent behaviour is remembered.
+ */
+struct ra_history {
+	unsigned short		hits;		/* readahead pages used */
+	unsigned short		misses;		/* readahead pages dropped unused */
+	unsigned short		seq;		/* readahead windows for streams */
+	unsigned short		random;		/* small random reads */
+};
+#endif
+
 struct address_space {
 	struct inode		*host;		/* owner: inode, block_device */
 	struct radix_tree_root	page_tree;	/* radix tree of all pages */
@@ -682,6 +696,7 @@ struct address_space {
 	struct mutex		i_mmap_mutex;	/* protect tree, count, list */
 	/* Protected by tree_lock together with the radix tree */
 	unsigned long		nrpages;	/* number of total pages */
+	unsigned long		nrshadows;	/* number of shadow entries */
 	pgoff_t			writeback_index;/* writeback starts here */
 	const struct address_space_operations *a_ops;	/* methods */
 	unsigned long		flags;		/* error bits/gfp mask */
@@ -692,6 +707,9 @@ struct address_space {
 #ifdef CONFIG_SDP
 	int userid;
 #endif
+#ifdef CONFIG_READAHEAD_HISTORY
+	struct ra_history	ra_history;	/* see mm/readahead.c */
+#endif
 } __attribute__((aligned(sizeof(long))));
 	/*
 	 * On most architectures that alignment is already the case; but
@@ -1883,6 +1901,7 @@ struct file_system_type {
 #define FS_HAS_SUBTYPE         4
 #define FS_USERNS_MOUNT                8       /* Can be mounted by userns root */
 #define FS_USERNS_DEV_MOUNT    16 /* A userns mount does not imply MNT_NODEV */
+#define FS_GROUP_FSYNC         32      /* ->sync_fs(sb, 1) is a cheap commit of all written data */
 #define FS_REVAL_DOT           16384   /* Check the paths ".", ".." for staleness */
 #define FS_RENAME_DOES_D_MOVE  32768   /* FS will handle d_move() during rename() internally. */
 	struct dentry *(*mount) (struct file_system_type *, int,
@@ -370,6 +370,7 @@ extern void __free_pages(struct page *page, unsigned int order);
 extern void free_pages(unsigned long addr, unsigned int order);
 extern void free_hot_cold_page(struct page *page, int cold);
 extern void free_hot_cold_page_list(struct list_head *list, int cold);
+extern void free_page_list(struct list_head *list);
 
 #define __free_page(page) __free_pages((page), 0)
 #define free_page(addr) free_pages((addr), 0)
@@ -406,6 +407,10 @@ static inline bool pm_suspended_storage(void)
 extern int alloc_contig_range(unsigned long start, unsigned long end,
 			      unsigned migratetype);
 extern void free_contig_range(unsigned long pfn, unsigned nr_pages);
+extern int drain_contig_range(unsigned long start, unsigned long end,
+			      unsigned migratetype);
+extern void cma_hold_movable(unsigned long pfn);
+extern void cma_release_movable(unsigned long pfn);
 
 /* CMA stuff */
 extern void init_cma_reserved_pageblock(struct page *page);
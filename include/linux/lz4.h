@@ -0,0 +1,34 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ * LZ4 Kernel Interface
+ *
+ * Decompression of raw LZ4 blocks (no frame header), as produced by
+ * LZ4_compress() and friends.  See http://code.google.com/p/lz4/ for
+ * the format description.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/types.h>
+
+/*
+ * lz4_decompress_unknownoutputsize()
+ *	src     : source address of the compressed data
+ *	src_len : is the input size, therefore the compressed size
+ *	dest    : output buffer address of the decompressed data
+ *	dest_len: is the size of the destination buffer
+ *		  (which must be already allocated), and is updated
+ *		  with the decompressed size on success
+ *	return  : Success if return 0
+ *		  Error if return (< 0)
+ *	note :  Destination buffer must be already allocated.
+ *		The whole of src must be one LZ4 block; this never reads
+ *		beyond src + src_len nor writes beyond dest + *dest_len.
+ */
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len);
+
+#endif
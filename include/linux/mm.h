@@ -198,6 +198,10 @@ struct vm_fault {
 					 * is set (which is also implied by
 					 * VM_FAULT_ERROR).
 					 */
+	/* for ->map_pages() only */
+	pgoff_t max_pgoff;		/* map pages for offset from pgoff till
+					 * max_pgoff inclusive */
+	pte_t *pte;			/* pte entry associated with ->pgoff */
 };
 
 /*
@@ -209,6 +213,7 @@ struct vm_operations_struct {
 	void (*open)(struct vm_area_struct * area);
 	void (*close)(struct vm_area_struct * area);
 	int (*fault)(struct vm_area_struct *vma, struct vm_fault *vmf);
+	void (*map_pages)(struct vm_area_struct *vma, struct vm_fault *vmf);
 
 	/* notification that a previously read-only page is about to become
 	 * writable, if an error is returned it will cause a SIGBUS */
@@ -1001,11 +1006,19 @@ int generic_error_remove_page(struct address_space *mapping, struct page *page);
 
 int invalidate_inode_page(struct page *page);
 
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte, bool write, bool anon);
+
 #ifdef CONFIG_MMU
 extern int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 			unsigned long address, unsigned int flags);
 extern int fixup_user_fault(struct task_struct *tsk, struct mm_struct *mm,
 			    unsigned long address, unsigned int fault_flags);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags,
+			unsigned long access);
+#endif
 #else
 static inline int handle_mm_fault(struct mm_struct *mm,
 			struct vm_area_struct *vma, unsigned long address,
@@ -1400,6 +1413,33 @@ static inline void vma_nonlinear_insert(struct vm_area_struct *vma,
 	list_add_tail(&vma->shared.vm_set.list, list);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Changes to a vma's range, flags, protection or page tables that a
+ * speculative fault must not miss are bracketed by vma_write_begin()
+ * and vma_write_end(), under mmap_sem held for writing.  Freeing page
+ * tables or vmas additionally waits for speculative faults in flight,
+ * see handle_speculative_fault().
+ */
+static inline void vma_write_begin(struct vm_area_struct *vma)
+{
+	write_seqcount_begin(&vma->vm_sequence);
+}
+
+static inline void vma_write_end(struct vm_area_struct *vma)
+{
+	write_seqcount_end(&vma->vm_sequence);
+}
+
+extern void mm_spf_block(struct mm_struct *mm);
+extern void mm_spf_unblock(struct mm_struct *mm);
+#else
+static inline void vma_write_begin(struct vm_area_struct *vma) {}
+static inline void vma_write_end(struct vm_area_struct *vma) {}
+static inline void mm_spf_block(struct mm_struct *mm) {}
+static inline void mm_spf_unblock(struct mm_struct *mm) {}
+#endif
+
 /* mmap.c */
 extern int __vm_enough_memory(struct mm_struct *mm, long pages, int cap_sys_admin);
 extern int vma_adjust(struct vm_area_struct *vma, unsigned long start,
@@ -1452,11 +1492,13 @@ extern unsigned long vm_mmap(struct file *, unsigned long,
 
 /* truncate.c */
 extern void truncate_inode_pages(struct address_space *, loff_t);
+extern void clear_shadow_entries(struct address_space *, pgoff_t, pgoff_t);
 extern void truncate_inode_pages_range(struct address_space *,
 				       loff_t lstart, loff_t lend);
 
 /* generic vm_area_ops exported for stackable file systems */
 extern int filemap_fault(struct vm_area_struct *, struct vm_fault *);
+extern void filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf);
 
 /* mm/page-writeback.c */
 int write_one_page(struct page *page, int wait);
@@ -1487,6 +1529,34 @@ unsigned long ra_submit(struct file_ra_state *ra,
 			struct address_space *mapping,
 			struct file *filp);
 
+#ifdef CONFIG_READAHEAD_HISTORY
+void ra_history_account(struct address_space *mapping, bool hit);
+
+/*
+ * A page brought in by readahead is being used.  Test before clearing,
+ * this is called on every page cache hit.
+ */
+static inline void ra_history_page_used(struct address_space *mapping,
+					struct page *page)
+{
+	if (PageReadaheadWindow(page) && TestClearPageReadaheadWindow(page))
+		ra_history_account(mapping, true);
+}
+
+/* A page is leaving the page cache, maybe without having been used */
+static inline void ra_history_page_dropped(struct address_space *mapping,
+					   struct page *page)
+{
+	if (PageReadaheadWindow(page) && TestClearPageReadaheadWindow(page))
+		ra_history_account(mapping, false);
+}
+#else
+static inline void ra_history_page_used(struct address_space *mapping,
+					struct page *page) {}
+static inline void ra_history_page_dropped(struct address_space *mapping,
+					   struct page *page) {}
+#endif
+
 /* Generic expand stack which grows the stack according to GROWS{UP,DOWN} */
 extern int expand_stack(struct vm_area_struct *vma, unsigned long address);
 
@@ -1503,6 +1573,10 @@ extern int expand_upwards(struct vm_area_struct *vma, unsigned long address);
 extern struct vm_area_struct * find_vma(struct mm_struct * mm, unsigned long addr);
 extern struct vm_area_struct * find_vma_prev(struct mm_struct * mm, unsigned long addr,
 					     struct vm_area_struct **pprev);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern struct vm_area_struct *find_vma_speculative(struct mm_struct *mm,
+						   unsigned long addr);
+#endif
 
 /* Look up the first VMA which intersects the interval start_addr..end_addr-1,
    NULL if none.  Assume start_addr < end_addr. */
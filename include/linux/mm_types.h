@@ -10,6 +10,7 @@
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
 #include <linux/completion.h>
+#include <linux/seqlock.h>
 #include <linux/cpumask.h>
 #include <linux/page-debug-flags.h>
 #include <asm/page.h>
@@ -257,6 +258,10 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	seqcount_t vm_sequence;		/* Bumped around changes that
+					   speculative faults must see */
+#endif
 };
 
 struct core_thread {
@@ -294,6 +299,12 @@ struct mm_struct {
 	struct vm_area_struct * mmap;		/* list of VMAs */
 	struct rb_root mm_rb;
 	struct vm_area_struct * mmap_cache;	/* last find_vma result */
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	rwlock_t mm_rb_lock;			/* mm_rb against lockless lookups */
+	atomic_t spf_active;			/* speculative faults in flight */
+	int spf_blocked;			/* teardown or mremap in progress */
+	wait_queue_head_t spf_wait;		/* teardown waits for spf_active */
+#endif
 #ifdef CONFIG_MMU
 	unsigned long (*get_unmapped_area) (struct file *filp,
 				unsigned long addr, unsigned long len,
@@ -242,6 +242,10 @@ enum mmc_blk_status {
 struct mmc_wr_pack_stats {
 	u32 *packing_events;
 	u32 pack_stop_reason[MAX_REASONS];
+	u32 hold_events;	/* waits for more writes before packing */
+	u32 hold_fruitless;	/* waits that added no request */
+	u32 hold_reqs;		/* requests added while waiting */
+	u32 hold_cut;		/* waits ended by a read, flush or FUA */
 	spinlock_t lock;
 	bool enabled;
 	bool print_in_read;
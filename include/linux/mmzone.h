@@ -7,6 +7,7 @@
 #include <linux/spinlock.h>
 #include <linux/list.h>
 #include <linux/wait.h>
+#include <linux/mutex.h>
 #include <linux/bitops.h>
 #include <linux/cache.h>
 #include <linux/threads.h>
@@ -141,6 +142,9 @@ enum zone_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_DIRTIED,		/* page dirtyings since bootup */
 	NR_WRITTEN,		/* page writings since bootup */
+	WORKINGSET_REFAULT,	/* evicted file pages faulted back in */
+	WORKINGSET_ACTIVATE,	/* ... and activated right away */
+	WORKINGSET_NODERECLAIM,	/* shadow-only tree nodes reclaimed */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -395,7 +399,11 @@ struct zone {
 	seqlock_t		span_seqlock;
 #endif
 #ifdef CONFIG_CMA
-	bool			cma_alloc;
+	/*
+	 * Non-zero while CMA pageblocks are being claimed or drained:
+	 * movable allocations then stay off MIGRATE_CMA free lists.
+	 */
+	atomic_t		cma_alloc;
 #endif
 	struct free_area	free_area[MAX_ORDER];
 
@@ -438,6 +446,9 @@ struct zone {
 	 */
 	unsigned int inactive_ratio;
 
+	/* Evictions & activations on the inactive file list */
+	atomic_long_t		inactive_age;
+
 
 	ZONE_PADDING(_pad2_)
 	/* Rarely used or read-mostly fields */
@@ -683,6 +694,9 @@ extern struct page *mem_map;
  * Memory statistics and page replacement data structures are maintained on a
  * per-zone basis.
  */
+/* Upper bound for vm.kswapd_threads, the number of kswapd threads per node */
+#define MAX_KSWAPD_THREADS 16
+
 struct bootmem_data;
 typedef struct pglist_data {
 	struct zone node_zones[MAX_NR_ZONES];
@@ -713,7 +727,23 @@ typedef struct pglist_data {
 					     range, including holes */
 	int node_id;
 	wait_queue_head_t kswapd_wait;
-	struct task_struct *kswapd;
+	struct task_struct *kswapd[MAX_KSWAPD_THREADS];
+	/*
+	 * Number of kswapd threads not fully asleep.  The node switches
+	 * to and from its "kswapd awake" state (pressure vmstat
+	 * thresholds, kswapd_running) only on the first wakeup and the
+	 * last sleep.
+	 */
+	int kswapd_awake;
+	struct mutex kswapd_awake_lock;
+	/*
+	 * Pending kswapd request.  Each one gets a new kswapd_req_seq and
+	 * is cleared once all kswapd_nr_threads threads have read it.
+	 */
+	spinlock_t kswapd_req_lock;
+	unsigned int kswapd_req_seq;
+	int kswapd_req_readers;
+	int kswapd_nr_threads;
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
 } pg_data_t;
@@ -848,6 +878,8 @@ static inline int is_dma(struct zone *zone)
 struct ctl_table;
 int min_free_kbytes_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
+int kswapd_threads_sysctl_handler(struct ctl_table *, int,
+					void __user *, size_t *, loff_t *);
 extern int sysctl_lowmem_reserve_ratio[MAX_NR_ZONES-1];
 int lowmem_reserve_ratio_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
@@ -349,6 +349,10 @@ struct napi_struct {
 	struct list_head	dev_list;
 	struct sk_buff		*gro_list;
 	struct sk_buff		*skb;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	struct hlist_node	napi_hash_node;
+	unsigned int		napi_id;
+#endif
 };
 
 enum {
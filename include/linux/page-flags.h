@@ -238,6 +238,9 @@ PAGEFLAG(MappedToDisk, mappedtodisk)
 /* PG_readahead is only used for file reads; PG_reclaim is only for writes */
 PAGEFLAG(Reclaim, reclaim) TESTCLEARFLAG(Reclaim, reclaim)
 PAGEFLAG(Readahead, reclaim)		/* Reminder to do async read-ahead */
+/* Read ahead beyond what was asked for, not yet used */
+TESTPAGEFLAG(ReadaheadWindow, readahead) __SETPAGEFLAG(ReadaheadWindow, readahead)
+TESTCLEARFLAG(ReadaheadWindow, readahead)
 
 #ifdef CONFIG_HIGHMEM
 /*
@@ -0,0 +1,94 @@
+/*
+ * net busy poll support
+ *
+ * Sockets with a non-zero sk_ll_usec (SO_BUSY_POLL, or the
+ * net.core.busy_read sysctl for new sockets) spin on the NAPI context
+ * that last delivered a packet to them instead of sleeping until the
+ * interrupt, softirq and wakeup chain hands them the data.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#ifndef _LINUX_NET_BUSY_POLL_H
+#define _LINUX_NET_BUSY_POLL_H
+
+#include <linux/netdevice.h>
+#include <linux/sched.h>
+#include <net/sock.h>
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+
+extern unsigned int sysctl_net_busy_read __read_mostly;
+
+/* napi_id values below this are reserved (0 means "not marked") */
+#define MIN_NAPI_ID 1
+
+#define BUSY_POLL_BUDGET 8
+
+static inline bool sk_can_busy_loop(const struct sock *sk)
+{
+	return sk->sk_ll_usec && sk->sk_napi_id &&
+	       !signal_pending(current);
+}
+
+/* a wrapper to make debug_smp_processor_id() happy:
+ * we can use local_clock() because we don't care about
+ * which CPU the clock came from while spinning.
+ */
+static inline u64 busy_loop_us_clock(void)
+{
+	return local_clock() >> 10;
+}
+
+static inline unsigned long sk_busy_loop_end_time(struct sock *sk)
+{
+	return busy_loop_us_clock() + ACCESS_ONCE(sk->sk_ll_usec);
+}
+
+static inline bool busy_loop_timeout(unsigned long end_time)
+{
+	unsigned long now = busy_loop_us_clock();
+
+	return time_after(now, end_time);
+}
+
+extern bool sk_busy_loop(struct sock *sk, int nonblock);
+
+/* used in the NIC receive handler to mark the skb */
+static inline void skb_mark_napi_id(struct sk_buff *skb,
+				    struct napi_struct *napi)
+{
+	skb->napi_id = napi->napi_id;
+}
+
+/* used in the protocol handler to propagate the napi_id to the socket */
+static inline void sk_mark_napi_id(struct sock *sk, const struct sk_buff *skb)
+{
+	sk->sk_napi_id = skb->napi_id;
+}
+
+#else /* CONFIG_NET_RX_BUSY_POLL */
+
+static inline bool sk_can_busy_loop(const struct sock *sk)
+{
+	return false;
+}
+
+static inline bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	return false;
+}
+
+static inline void skb_mark_napi_id(struct sk_buff *skb,
+				    struct napi_struct *napi)
+{
+}
+
+static inline void sk_mark_napi_id(struct sock *sk, const struct sk_buff *skb)
+{
+}
+
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+#endif /* _LINUX_NET_BUSY_POLL_H */
@@ -259,6 +259,7 @@ extern int sysctl_tcp_cookie_size;
 extern int sysctl_tcp_thin_linear_timeouts;
 extern int sysctl_tcp_thin_dupack;
 extern int sysctl_tcp_default_init_rwnd;
+extern int sysctl_tcp_limit_output_bytes;
 
 /* sysctl variables for controlling various tcp parameters */
 extern int sysctl_tcp_delack_seg;
@@ -507,6 +508,9 @@ extern int tcp_syn_flood_action(struct sock *sk,
 extern void tcp_push_one(struct sock *, unsigned int mss_now);
 extern void tcp_send_ack(struct sock *sk);
 extern void tcp_send_delayed_ack(struct sock *sk);
+extern void tcp_wfree(struct sk_buff *skb);
+extern void tcp_release_cb(struct sock *sk);
+extern void tcp_tasklet_init(void);
 
 /* tcp_input.c */
 extern void tcp_cwnd_application_limited(struct sock *sk);
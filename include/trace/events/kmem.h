@@ -463,6 +463,110 @@ DEFINE_EVENT(alloc_retry, dma_alloc_contiguous_retry,
 	TP_ARGS(tries)
 );
 
+TRACE_EVENT(cma_alloc_start,
+
+	TP_PROTO(int count, unsigned int align),
+
+	TP_ARGS(count, align),
+
+	TP_STRUCT__entry(
+		__field(int,		count)
+		__field(unsigned int,	align)
+	),
+
+	TP_fast_assign(
+		__entry->count	= count;
+		__entry->align	= align;
+	),
+
+	TP_printk("count=%d align=%u",
+		__entry->count,
+		__entry->align)
+);
+
+TRACE_EVENT(cma_alloc,
+
+	TP_PROTO(unsigned long pfn, int count, unsigned int align,
+		 int tries, unsigned long usecs),
+
+	TP_ARGS(pfn, count, align, tries, usecs),
+
+	TP_STRUCT__entry(
+		__field(unsigned long,	pfn)
+		__field(int,		count)
+		__field(unsigned int,	align)
+		__field(int,		tries)
+		__field(unsigned long,	usecs)
+	),
+
+	TP_fast_assign(
+		__entry->pfn	= pfn;
+		__entry->count	= count;
+		__entry->align	= align;
+		__entry->tries	= tries;
+		__entry->usecs	= usecs;
+	),
+
+	TP_printk("pfn=%lx count=%d align=%u tries=%d usecs=%lu",
+		__entry->pfn,
+		__entry->count,
+		__entry->align,
+		__entry->tries,
+		__entry->usecs)
+);
+
+TRACE_EVENT(cma_migrate_fail,
+
+	TP_PROTO(unsigned long pfn, int count, int ret),
+
+	TP_ARGS(pfn, count, ret),
+
+	TP_STRUCT__entry(
+		__field(unsigned long,	pfn)
+		__field(int,		count)
+		__field(int,		ret)
+	),
+
+	TP_fast_assign(
+		__entry->pfn	= pfn;
+		__entry->count	= count;
+		__entry->ret	= ret;
+	),
+
+	TP_printk("pfn=%lx count=%d ret=%d",
+		__entry->pfn,
+		__entry->count,
+		__entry->ret)
+);
+
+TRACE_EVENT(cma_drain,
+
+	TP_PROTO(unsigned long pfn, unsigned long count, int ret,
+		 unsigned long usecs),
+
+	TP_ARGS(pfn, count, ret, usecs),
+
+	TP_STRUCT__entry(
+		__field(unsigned long,	pfn)
+		__field(unsigned long,	count)
+		__field(int,		ret)
+		__field(unsigned long,	usecs)
+	),
+
+	TP_fast_assign(
+		__entry->pfn	= pfn;
+		__entry->count	= count;
+		__entry->ret	= ret;
+		__entry->usecs	= usecs;
+	),
+
+	TP_printk("pfn=%lx count=%lu ret=%d usecs=%lu",
+		__entry->pfn,
+		__entry->count,
+		__entry->ret,
+		__entry->usecs)
+);
+
 DECLARE_EVENT_CLASS(migrate_pages,
 
 	TP_PROTO(int mode),
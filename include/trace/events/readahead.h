@@ -0,0 +1,70 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM readahead
+
+#if !defined(_TRACE_READAHEAD_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_READAHEAD_H
+
+#include <linux/fs.h>
+#include <linux/tracepoint.h>
+
+/*
+ * A readahead decision on a file, along with the inode's readahead
+ * history the window was sized from: pages read ahead and used (hits)
+ * or dropped unused (misses), and stream vs random read decisions.
+ */
+TRACE_EVENT(readahead_window,
+
+	TP_PROTO(struct address_space *mapping, pgoff_t offset,
+		 unsigned long req_size, pgoff_t start,
+		 unsigned long size, unsigned long async_size),
+
+	TP_ARGS(mapping, offset, req_size, start, size, async_size),
+
+	TP_STRUCT__entry(
+		__field(dev_t,		dev)
+		__field(unsigned long,	ino)
+		__field(pgoff_t,	offset)
+		__field(unsigned long,	req_size)
+		__field(pgoff_t,	start)
+		__field(unsigned long,	size)
+		__field(unsigned long,	async_size)
+		__field(unsigned short,	hits)
+		__field(unsigned short,	misses)
+		__field(unsigned short,	seq)
+		__field(unsigned short,	random)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= mapping->host->i_sb->s_dev;
+		__entry->ino		= mapping->host->i_ino;
+		__entry->offset		= offset;
+		__entry->req_size	= req_size;
+		__entry->start		= start;
+		__entry->size		= size;
+		__entry->async_size	= async_size;
+		__entry->hits		= mapping->ra_history.hits;
+		__entry->misses		= mapping->ra_history.misses;
+		__entry->seq		= mapping->ra_history.seq;
+		__entry->random		= mapping->ra_history.random;
+	),
+
+	TP_printk("dev %d:%d ino %lu offset=%lu req_size=%lu "
+		  "start=%lu size=%lu async_size=%lu "
+		  "hits=%u misses=%u seq=%u random=%u",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  __entry->ino,
+		  (unsigned long)__entry->offset,
+		  __entry->req_size,
+		  (unsigned long)__entry->start,
+		  __entry->size,
+		  __entry->async_size,
+		  __entry->hits,
+		  __entry->misses,
+		  __entry->seq,
+		  __entry->random)
+);
+
+#endif /* _TRACE_READAHEAD_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,138 @@
+/*
+ * LZ4 Decompressor for Linux kernel
+ *
+ * Decodes raw LZ4 blocks.  A block is a sequence of
+ *
+ *	token | [literal length bytes] | literals | offset | [match length bytes]
+ *
+ * where the high nibble of the token is the literal run length and the low
+ * nibble the match length minus MINMATCH, a nibble of 15 being extended by
+ * following bytes until one is not 255.  The offset is 16 bit little endian
+ * and counts back from the current output position.  The last sequence of a
+ * block carries literals only.
+ *
+ * Every length and offset read from the input is checked against the input
+ * and output buffers, so corrupted or malicious input cannot make this read
+ * or write out of bounds.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#endif
+#include <linux/string.h>
+#include <linux/lz4.h>
+
+#include <asm/unaligned.h>
+
+#define MINMATCH	4
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+/*
+ * Read the extension bytes of a length whose nibble was saturated.
+ * Returns false if the input runs out first.
+ */
+static inline bool lz4_read_length(const u8 **ipp, const u8 *iend,
+				   size_t *length)
+{
+	const u8 *ip = *ipp;
+	unsigned int s;
+
+	do {
+		if (unlikely(ip >= iend))
+			return false;
+		s = *ip++;
+		*length += s;
+	} while (s == 255);
+
+	*ipp = ip;
+	return true;
+}
+
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len)
+{
+	const u8 *ip = src;
+	const u8 * const iend = src + src_len;
+	u8 *op = dest;
+	u8 * const oend = dest + *dest_len;
+
+	for (;;) {
+		unsigned int token;
+		size_t length, offset;
+		const u8 *match;
+
+		if (unlikely(ip >= iend))
+			goto _output_error;
+
+		/* get runlength */
+		token = *ip++;
+		length = token >> ML_BITS;
+		if (length == RUN_MASK && !lz4_read_length(&ip, iend, &length))
+			goto _output_error;
+
+		/* copy literals */
+		if (unlikely(length > (size_t)(iend - ip) ||
+			     length > (size_t)(oend - op)))
+			goto _output_error;
+		memcpy(op, ip, length);
+		ip += length;
+		op += length;
+
+		/* the last sequence has no match part */
+		if (ip == iend)
+			break;
+
+		/* get offset */
+		if (unlikely(iend - ip < 2))
+			goto _output_error;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(offset == 0 || offset > (size_t)(op - dest)))
+			goto _output_error;
+		match = op - offset;
+
+		/* get matchlength */
+		length = token & ML_MASK;
+		if (length == ML_MASK && !lz4_read_length(&ip, iend, &length))
+			goto _output_error;
+		length += MINMATCH;
+		if (unlikely(length > (size_t)(oend - op)))
+			goto _output_error;
+
+		/*
+		 * copy repeated sequence.  When it overlaps its own output
+		 * (offset < length) the bytes copied so far repeat with
+		 * period offset, so the non-overlapping window can double
+		 * with each copy.
+		 */
+		while (length > offset) {
+			memcpy(op, match, offset);
+			op += offset;
+			length -= offset;
+			offset <<= 1;
+		}
+		memcpy(op, match, length);
+		op += length;
+	}
+
+	*dest_len = op - dest;
+	return 0;
+
+	/* write overflow error detected */
+_output_error:
+	return -1;
+}
+#ifndef STATIC
+EXPORT_SYMBOL(lz4_decompress_unknownoutputsize);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+#endif
@@ -21,5 +21,10 @@ struct mm_struct init_mm = {
 	.mmap_sem	= __RWSEM_INITIALIZER(init_mm.mmap_sem),
 	.page_table_lock =  __SPIN_LOCK_UNLOCKED(init_mm.page_table_lock),
 	.mmlist		= LIST_HEAD_INIT(init_mm.mmlist),
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	.mm_rb_lock	= __RW_LOCK_UNLOCKED(init_mm.mm_rb_lock),
+	.spf_active	= ATOMIC_INIT(0),
+	.spf_wait	= __WAIT_QUEUE_HEAD_INITIALIZER(init_mm.spf_wait),
+#endif
 	INIT_MM_CONTEXT(init_mm)
 };
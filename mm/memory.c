@@ -3457,6 +3457,154 @@ oom:
 	return VM_FAULT_OOM;
 }
 
+/**
+ * do_set_pte - setup new PTE entry for given page and add reverse page mapping.
+ *
+ * @vma: virtual memory area
+ * @address: user virtual address
+ * @page: page to map
+ * @pte: pointer to target page table entry
+ * @write: true, if new entry is writable
+ * @anon: true, if it's anonymous page
+ *
+ * Caller must hold page table lock relevant for @pte.
+ *
+ * Target users are page handler itself and implementations of
+ * vm_ops->map_pages.
+ */
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte, bool write, bool anon)
+{
+	pte_t entry;
+
+	flush_icache_page(vma, page);
+	entry = mk_pte(page, vma->vm_page_prot);
+	if (write)
+		entry = maybe_mkwrite(pte_mkdirty(entry), vma);
+	if (anon) {
+		inc_mm_counter_fast(vma->vm_mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+	} else {
+		inc_mm_counter_fast(vma->vm_mm, MM_FILEPAGES);
+		page_add_file_rmap(page);
+	}
+	set_pte_at(vma->vm_mm, address, pte, entry);
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, address, pte);
+}
+
+/*
+ * Size of the window, in bytes, that a read fault on a file mapping
+ * tries to populate from the page cache.  Must be a power of two no
+ * smaller than PAGE_SIZE; PAGE_SIZE disables fault-around.
+ */
+static unsigned long fault_around_bytes = 65536;
+
+static inline unsigned long fault_around_pages(void)
+{
+	return ACCESS_ONCE(fault_around_bytes) >> PAGE_SHIFT;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int fault_around_bytes_get(void *data, u64 *val)
+{
+	*val = fault_around_bytes;
+	return 0;
+}
+
+static int fault_around_bytes_set(void *data, u64 val)
+{
+	if (val / PAGE_SIZE > PTRS_PER_PTE)
+		return -EINVAL;
+	if (val > PAGE_SIZE)
+		fault_around_bytes = rounddown_pow_of_two(val);
+	else
+		fault_around_bytes = PAGE_SIZE; /* rounddown_pow_of_two(0) is undefined */
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(fault_around_bytes_fops,
+		fault_around_bytes_get, fault_around_bytes_set, "%llu\n");
+
+static int __init fault_around_debugfs(void)
+{
+	void *ret;
+
+	ret = debugfs_create_file("fault_around_bytes", 0644, NULL, NULL,
+			&fault_around_bytes_fops);
+	if (!ret)
+		pr_warn("Failed to create fault_around_bytes in debugfs");
+	return 0;
+}
+late_initcall(fault_around_debugfs);
+#endif
+
+/*
+ * do_fault_around() tries to map a few pages around the fault address. The
+ * hope is that the pages will be needed soon and this will lower the number
+ * of faults to handle.
+ *
+ * It uses vm_ops->map_pages() to map the pages, which skips the page if it's
+ * not ready to be mapped: not up-to-date, locked, etc.
+ *
+ * This function is called with the page table lock taken. In the split ptlock
+ * case the page table lock only protects those entries which belong to
+ * the page table corresponding to the fault address.
+ *
+ * This function doesn't cross the VMA boundaries, in order to call map_pages()
+ * only once.
+ *
+ * fault_around_pages() defines how many pages we'll try to map.
+ * do_fault_around() expects it to be a power of two and less than or equal
+ * to PTRS_PER_PTE.
+ *
+ * The virtual address of the area that we map is naturally aligned to the
+ * fault_around_pages() value (and therefore to page order).  This way it's
+ * easier to guarantee that we don't cross page table boundaries.
+ */
+static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
+		pte_t *pte, pgoff_t pgoff, unsigned int flags)
+{
+	unsigned long start_addr, nr_pages, mask;
+	pgoff_t max_pgoff;
+	struct vm_fault vmf;
+	int off;
+
+	nr_pages = fault_around_pages();
+	mask = ~(nr_pages * PAGE_SIZE - 1) & PAGE_MASK;
+
+	start_addr = max(address & mask, vma->vm_start);
+	off = ((address - start_addr) >> PAGE_SHIFT) & (PTRS_PER_PTE - 1);
+	pte -= off;
+	pgoff -= off;
+
+	/*
+	 *  max_pgoff is either end of page table or end of vma
+	 *  or fault_around_pages() from pgoff, depending what is nearest.
+	 */
+	max_pgoff = pgoff - ((start_addr >> PAGE_SHIFT) & (PTRS_PER_PTE - 1)) +
+		PTRS_PER_PTE - 1;
+	max_pgoff = min3(max_pgoff, vma_pages(vma) + vma->vm_pgoff - 1,
+			pgoff + nr_pages - 1);
+
+	/* Check if it makes any sense to call ->map_pages */
+	while (!pte_none(*pte)) {
+		if (++pgoff > max_pgoff)
+			return;
+		start_addr += PAGE_SIZE;
+		if (start_addr >= vma->vm_end)
+			return;
+		pte++;
+	}
+
+	vmf.virtual_address = (void __user *) start_addr;
+	vmf.pte = pte;
+	vmf.pgoff = pgoff;
+	vmf.max_pgoff = max_pgoff;
+	vmf.flags = flags;
+	vma->vm_ops->map_pages(vma, &vmf);
+}
+
 /*
  * __do_fault() tries to create a new page mapping. It aggressively
  * tries to share with existing pages, but makes a separate copy if
@@ -3478,13 +3626,29 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	spinlock_t *ptl;
 	struct page *page;
 	struct page *cow_page;
-	pte_t entry;
 	int anon = 0;
 	struct page *dirty_page = NULL;
 	struct vm_fault vmf;
 	int ret;
 	int page_mkwrite = 0;
 
+	/*
+	 * On a read fault, let the filesystem map whatever neighbouring
+	 * pages it already has cached before doing the expensive ->fault().
+	 * If that happened to cover the faulting address, we are done.
+	 */
+	if (!(flags & FAULT_FLAG_WRITE) && vma->vm_ops->map_pages &&
+	    !(flags & FAULT_FLAG_NONLINEAR) && fault_around_pages() > 1) {
+		page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+		do_fault_around(vma, address, page_table, pgoff, flags);
+		if (!pte_same(*page_table, orig_pte)) {
+			pte_unmap_unlock(page_table, ptl);
+			count_vm_event(FAULTAROUND_HIT);
+			return 0;
+		}
+		pte_unmap_unlock(page_table, ptl);
+	}
+
 	/*
 	 * If we do COW later, allocate page befor taking lock_page()
 	 * on the file cache page. This will reduce lock holding time.
@@ -3587,25 +3751,12 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	 */
 	/* Only go through if we didn't race with anybody else... */
 	if (likely(pte_same(*page_table, orig_pte))) {
-		flush_icache_page(vma, page);
-		entry = mk_pte(page, vma->vm_page_prot);
-		if (flags & FAULT_FLAG_WRITE)
-			entry = maybe_mkwrite(pte_mkdirty(entry), vma);
-		if (anon) {
-			inc_mm_counter_fast(mm, MM_ANONPAGES);
-			page_add_new_anon_rmap(page, vma, address);
-		} else {
-			inc_mm_counter_fast(mm, MM_FILEPAGES);
-			page_add_file_rmap(page);
-			if (flags & FAULT_FLAG_WRITE) {
-				dirty_page = page;
-				get_page(dirty_page);
-			}
+		if (!anon && (flags & FAULT_FLAG_WRITE)) {
+			dirty_page = page;
+			get_page(dirty_page);
 		}
-		set_pte_at(mm, address, page_table, entry);
-
-		/* no need to invalidate: a not-present page won't be cached */
-		update_mmu_cache(vma, address, page_table);
+		do_set_pte(vma, address, page, page_table,
+			   flags & FAULT_FLAG_WRITE, anon);
 	} else {
 		if (cow_page)
 			mem_cgroup_uncharge_page(cow_page);
@@ -3833,6 +3984,358 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults.
+ *
+ * Threads faulting on their own memory otherwise queue up on mmap_sem
+ * behind whoever is doing an mmap(), munmap() or mprotect(), even when
+ * the vmas involved have nothing to do with each other.  The common,
+ * cheap faults - anonymous pages, page cache read faults and accessed
+ * or dirty bit updates - are first attempted without mmap_sem:
+ *
+ *  - the vma is looked up under mm->mm_rb_lock and copied, the copy
+ *    being validated against vma->vm_sequence, so the fault runs on a
+ *    consistent snapshot of the vma;
+ *  - the sequence is checked again under the pte lock before the pte
+ *    is touched.  mprotect and munmap bump it before they go
+ *    for the pte lock themselves, so either they see our pte or we
+ *    see their change and back off;
+ *  - page tables and vmas are only freed after mm_spf_block() has
+ *    waited for the speculative faults in flight, which also pins the
+ *    vma's file and anon_vma for as long as we use them;
+ *  - mremap keeps them blocked while it moves page tables into the
+ *    new vma, which is linked before its ptes are in place.
+ *
+ * Anything else, or any conflict, returns VM_FAULT_RETRY and the arch
+ * code falls back to handle_mm_fault() under mmap_sem.
+ */
+struct speculative_fault {
+	struct vm_area_struct *vma;	/* the live vma */
+	unsigned int seq;		/* its vm_sequence at snapshot time */
+	struct vm_area_struct snap;	/* what the fault works on */
+};
+
+/*
+ * Nests: mremap blocks speculative faults across copy_vma(), which may
+ * block and unblock again in vma_adjust().  Serialised by mmap_sem held
+ * for writing.
+ */
+void mm_spf_block(struct mm_struct *mm)
+{
+	mm->spf_blocked++;
+	smp_mb();
+	wait_event(mm->spf_wait, !atomic_read(&mm->spf_active));
+}
+
+void mm_spf_unblock(struct mm_struct *mm)
+{
+	smp_mb();
+	mm->spf_blocked--;
+}
+
+static void spf_exit(struct mm_struct *mm)
+{
+	if (atomic_dec_and_test(&mm->spf_active) &&
+	    waitqueue_active(&mm->spf_wait))
+		wake_up_all(&mm->spf_wait);
+}
+
+static bool spf_enter(struct mm_struct *mm)
+{
+	atomic_inc(&mm->spf_active);
+	smp_mb__after_atomic_inc();
+	if (likely(!ACCESS_ONCE(mm->spf_blocked)))
+		return true;
+	spf_exit(mm);
+	return false;
+}
+
+/*
+ * Map and lock the pte, provided the vma is still the one we took the
+ * snapshot of.  Returns NULL, with nothing locked, if it changed.
+ */
+static pte_t *spf_pte_map_lock(struct mm_struct *mm,
+		struct speculative_fault *sf, pmd_t *pmd,
+		unsigned long address, spinlock_t **ptlp)
+{
+	pte_t *pte = pte_offset_map_lock(mm, pmd, address, ptlp);
+
+	if (likely(!read_seqcount_retry(&sf->vma->vm_sequence, sf->seq)))
+		return pte;
+	pte_unmap_unlock(pte, *ptlp);
+	return NULL;
+}
+
+/*
+ * do_anonymous_page() without the stack guard page and anon_vma setup,
+ * both of which need mmap_sem: such faults are left to the slow path.
+ */
+static int spf_anonymous_page(struct mm_struct *mm,
+		struct speculative_fault *sf, unsigned long address,
+		pmd_t *pmd, unsigned int flags)
+{
+	struct vm_area_struct *vma = &sf->snap;
+	struct page *page = NULL;
+	spinlock_t *ptl;
+	pte_t *page_table;
+	pte_t entry;
+	int ret = VM_FAULT_RETRY;
+
+	if (vma->vm_flags & VM_SHARED)
+		return VM_FAULT_RETRY;
+
+	if (!(flags & FAULT_FLAG_WRITE)) {
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+						vma->vm_page_prot));
+	} else {
+		if (!vma->anon_vma)
+			return VM_FAULT_RETRY;
+		page = alloc_zeroed_user_highpage_movable(vma, address);
+		if (!page)
+			return VM_FAULT_RETRY;
+		__SetPageUptodate(page);
+
+		if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL)) {
+			page_cache_release(page);
+			return VM_FAULT_RETRY;
+		}
+
+		entry = mk_pte(page, vma->vm_page_prot);
+		if (vma->vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+	}
+
+	page_table = spf_pte_map_lock(mm, sf, pmd, address, &ptl);
+	if (!page_table)
+		goto release;
+	ret = 0;
+	if (!pte_none(*page_table))
+		goto unlock;
+
+	if (page) {
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+		page = NULL;
+	}
+	set_pte_at(mm, address, page_table, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, address, page_table);
+unlock:
+	pte_unmap_unlock(page_table, ptl);
+release:
+	if (page) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+	return ret;
+}
+
+/*
+ * The read fault half of __do_fault(), for page cache backed mappings:
+ * write faults may need ->page_mkwrite() or a COW and stay on the slow
+ * path.
+ */
+static int spf_read_fault(struct mm_struct *mm,
+		struct speculative_fault *sf, unsigned long address,
+		pmd_t *pmd, unsigned int flags, pte_t orig_pte)
+{
+	struct vm_area_struct *vma = &sf->snap;
+	pgoff_t pgoff = (((address & PAGE_MASK)
+			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+	struct vm_fault vmf;
+	spinlock_t *ptl;
+	pte_t *page_table;
+	int ret;
+
+	if (vma->vm_ops->map_pages && fault_around_pages() > 1) {
+		page_table = spf_pte_map_lock(mm, sf, pmd, address, &ptl);
+		if (!page_table)
+			return VM_FAULT_RETRY;
+		do_fault_around(vma, address, page_table, pgoff, flags);
+		if (!pte_same(*page_table, orig_pte)) {
+			pte_unmap_unlock(page_table, ptl);
+			count_vm_event(FAULTAROUND_HIT);
+			return 0;
+		}
+		pte_unmap_unlock(page_table, ptl);
+	}
+
+	vmf.virtual_address = (void __user *)(address & PAGE_MASK);
+	vmf.pgoff = pgoff;
+	vmf.flags = flags;
+	vmf.page = NULL;
+
+	ret = vma->vm_ops->fault(vma, &vmf);
+	/* Let the slow path report errors */
+	if (unlikely(ret & (VM_FAULT_ERROR | VM_FAULT_NOPAGE |
+			    VM_FAULT_RETRY)))
+		return VM_FAULT_RETRY;
+
+	if (unlikely(!(ret & VM_FAULT_LOCKED)))
+		lock_page(vmf.page);
+	ret &= VM_FAULT_MAJOR;
+
+	if (unlikely(PageHWPoison(vmf.page))) {
+		ret = VM_FAULT_RETRY;
+		goto release;
+	}
+
+	page_table = spf_pte_map_lock(mm, sf, pmd, address, &ptl);
+	if (!page_table) {
+		ret = VM_FAULT_RETRY;
+		goto release;
+	}
+	if (unlikely(!pte_same(*page_table, orig_pte))) {
+		pte_unmap_unlock(page_table, ptl);
+		goto release;
+	}
+	do_set_pte(vma, address, vmf.page, page_table, false, false);
+	pte_unmap_unlock(page_table, ptl);
+	unlock_page(vmf.page);
+	return ret;
+
+release:
+	unlock_page(vmf.page);
+	page_cache_release(vmf.page);
+	return ret;
+}
+
+/* The accessed/dirty bit update at the end of handle_pte_fault() */
+static int spf_access_fault(struct mm_struct *mm,
+		struct speculative_fault *sf, unsigned long address,
+		pmd_t *pmd, unsigned int flags, pte_t entry)
+{
+	struct vm_area_struct *vma = &sf->snap;
+	spinlock_t *ptl;
+	pte_t *pte;
+
+	/* COW and write notification go through do_wp_page() */
+	if ((flags & FAULT_FLAG_WRITE) && !pte_write(entry))
+		return VM_FAULT_RETRY;
+
+	pte = spf_pte_map_lock(mm, sf, pmd, address, &ptl);
+	if (!pte)
+		return VM_FAULT_RETRY;
+	if (unlikely(!pte_same(*pte, entry)))
+		goto unlock;
+	if (flags & FAULT_FLAG_WRITE)
+		entry = pte_mkdirty(entry);
+	entry = pte_mkyoung(entry);
+	if (ptep_set_access_flags(vma, address, pte, entry,
+				  flags & FAULT_FLAG_WRITE)) {
+		update_mmu_cache(vma, address, pte);
+	} else {
+		if (flags & FAULT_FLAG_WRITE)
+			flush_tlb_fix_spurious_fault(vma, address);
+	}
+unlock:
+	pte_unmap_unlock(pte, ptl);
+	return 0;
+}
+
+/**
+ * handle_speculative_fault - try to handle a user fault without mmap_sem
+ * @mm: the faulting task's mm
+ * @address: faulting address
+ * @flags: FAULT_FLAG_xxx flags
+ * @access: VM_READ/VM_WRITE/VM_EXEC bits, one of which the vma must allow
+ *
+ * Returns VM_FAULT_RETRY if the fault was not handled, in which case the
+ * caller must take mmap_sem and go through handle_mm_fault(), which also
+ * takes care of reporting bad accesses.  Otherwise returns 0 or
+ * VM_FAULT_MAJOR.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags, unsigned long access)
+{
+	struct speculative_fault sf;
+	struct vm_area_struct *vma;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+	pte_t entry;
+	int ret = VM_FAULT_RETRY;
+
+	/* Retrying, or being killed, would drop an mmap_sem we don't hold */
+	flags &= FAULT_FLAG_WRITE;
+
+	if (!spf_enter(mm))
+		goto out_fallback;
+
+	vma = find_vma_speculative(mm, address);
+	if (!vma)
+		goto out;
+	sf.vma = vma;
+	sf.seq = raw_seqcount_begin(&vma->vm_sequence);
+	sf.snap = *vma;
+	if (read_seqcount_retry(&vma->vm_sequence, sf.seq))
+		goto out;
+	vma = &sf.snap;
+
+	/*
+	 * The tree walk above is not covered by vm_sequence: the vma may
+	 * have been split or shrunk before the snapshot was taken, so check
+	 * that the snapshot itself still covers the address.
+	 */
+	if (address < vma->vm_start || address >= vma->vm_end)
+		goto out;
+	if (!(vma->vm_flags & access))
+		goto out;
+	/* Stack expansion, hugetlb, nonlinear and raw pfn maps: slow path */
+	if (vma->vm_flags & (VM_GROWSDOWN | VM_GROWSUP | VM_HUGETLB |
+			     VM_NONLINEAR | VM_PFNMAP | VM_MIXEDMAP))
+		goto out;
+	/* The policy may be freed by a concurrent mbind() */
+	if (vma_policy(vma))
+		goto out;
+
+	__set_current_state(TASK_RUNNING);
+
+	pgd = pgd_offset(mm, address);
+	pud = pud_alloc(mm, pgd, address);
+	if (!pud)
+		goto out;
+	pmd = pmd_alloc(mm, pud, address);
+	if (!pmd)
+		goto out;
+	if (unlikely(pmd_none(*pmd)) && __pte_alloc(mm, vma, pmd, address))
+		goto out;
+	if (unlikely(pmd_trans_huge(*pmd)))
+		goto out;
+
+	pte = pte_offset_map(pmd, address);
+	entry = *pte;
+	pte_unmap(pte);
+
+	if (pte_none(entry)) {
+		if (!vma->vm_ops)
+			ret = spf_anonymous_page(mm, &sf, address, pmd, flags);
+		else if (!(flags & FAULT_FLAG_WRITE) &&
+			 vma->vm_ops->fault == filemap_fault)
+			ret = spf_read_fault(mm, &sf, address, pmd, flags,
+					     entry);
+	} else if (pte_present(entry)) {
+		ret = spf_access_fault(mm, &sf, address, pmd, flags, entry);
+	}
+out:
+	spf_exit(mm);
+out_fallback:
+	if (ret & VM_FAULT_RETRY) {
+		count_vm_event(SPECULATIVE_PGFAULT_FALLBACK);
+		return ret;
+	}
+
+	count_vm_event(PGFAULT);
+	count_vm_event(SPECULATIVE_PGFAULT);
+	mem_cgroup_count_vm_event(mm, PGFAULT);
+	check_sync_rss_stat(current);
+	return ret;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -280,7 +280,13 @@ void munlock_vma_pages_range(struct vm_area_struct *vma,
 	unsigned long addr;
 
 	lru_add_drain();
+	/*
+	 * Invalidate speculative fault snapshots that still see VM_LOCKED,
+	 * so no page gets mlocked behind the walk below.
+	 */
+	vma_write_begin(vma);
 	vma->vm_flags &= ~VM_LOCKED;
+	vma_write_end(vma);
 
 	for (addr = start; addr < end; addr += PAGE_SIZE) {
 		struct page *page;
@@ -369,9 +375,11 @@ success:
 	 * set VM_LOCKED, __mlock_vma_pages_range will bring it back.
 	 */
 
-	if (lock)
+	if (lock) {
+		vma_write_begin(vma);
 		vma->vm_flags = newflags;
-	else
+		vma_write_end(vma);
+	} else
 		munlock_vma_pages_range(vma, start, end);
 
 out:
@@ -392,11 +392,28 @@ find_vma_prepare(struct mm_struct *mm, unsigned long addr,
 	return vma;
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+static inline void mm_rb_write_lock(struct mm_struct *mm)
+{
+	write_lock(&mm->mm_rb_lock);
+}
+
+static inline void mm_rb_write_unlock(struct mm_struct *mm)
+{
+	write_unlock(&mm->mm_rb_lock);
+}
+#else
+static inline void mm_rb_write_lock(struct mm_struct *mm) {}
+static inline void mm_rb_write_unlock(struct mm_struct *mm) {}
+#endif
+
 void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 		struct rb_node **rb_link, struct rb_node *rb_parent)
 {
+	mm_rb_write_lock(mm);
 	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
 	rb_insert_color(&vma->vm_rb, &mm->mm_rb);
+	mm_rb_write_unlock(mm);
 }
 
 static void __vma_link_file(struct vm_area_struct *vma)
@@ -476,7 +493,9 @@ __vma_unlink(struct mm_struct *mm, struct vm_area_struct *vma,
 	prev->vm_next = next;
 	if (next)
 		next->vm_prev = prev;
+	mm_rb_write_lock(mm);
 	rb_erase(&vma->vm_rb, &mm->mm_rb);
+	mm_rb_write_unlock(mm);
 	if (mm->mmap_cache == vma)
 		mm->mmap_cache = prev;
 }
@@ -501,6 +520,7 @@ int vma_adjust(struct vm_area_struct *vma, unsigned long start,
 	long adjust_next = 0;
 	int remove_next = 0;
 
+	vma_write_begin(vma);
 	if (next && !insert) {
 		struct vm_area_struct *exporter = NULL;
 
@@ -532,14 +552,20 @@ again:			remove_next = 1 + (end > next->vm_end);
 			importer = next;
 		}
 
+		if (exporter)
+			vma_write_begin(next);
+
 		/*
 		 * Easily overlooked: when mprotect shifts the boundary,
 		 * make sure the expanding vma has anon_vma set if the
 		 * shrinking vma had, to cover any anon pages imported.
 		 */
 		if (exporter && exporter->anon_vma && !importer->anon_vma) {
-			if (anon_vma_clone(importer, exporter))
+			if (anon_vma_clone(importer, exporter)) {
+				vma_write_end(next);
+				vma_write_end(vma);
 				return -ENOMEM;
+			}
 			importer->anon_vma = exporter->anon_vma;
 		}
 	}
@@ -618,6 +644,12 @@ again:			remove_next = 1 + (end > next->vm_end);
 		mutex_unlock(&mapping->i_mmap_mutex);
 
 	if (remove_next) {
+		/*
+		 * next is out of the rbtree: once no speculative fault
+		 * can still be looking at it, it is safe to free.
+		 */
+		mm_spf_block(mm);
+		mm_spf_unblock(mm);
 		if (file) {
 			fput(file);
 			if (next->vm_flags & VM_EXECUTABLE)
@@ -639,6 +671,9 @@ again:			remove_next = 1 + (end > next->vm_end);
 		}
 	}
 
+	if (adjust_next)
+		vma_write_end(next);
+	vma_write_end(vma);
 	validate_mm(mm);
 
 	return 0;
@@ -1696,6 +1731,39 @@ struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr)
 
 EXPORT_SYMBOL(find_vma);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * find_vma() for handle_speculative_fault(), which does not hold mmap_sem.
+ * mm_rb_lock keeps the tree walk safe against concurrent rebalancing,
+ * and being accounted in mm->spf_active keeps the returned vma from
+ * being freed; its fields must still be validated through vm_sequence.
+ * mmap_cache is left alone, a stale pointer there would outlive the vma.
+ */
+struct vm_area_struct *find_vma_speculative(struct mm_struct *mm,
+					    unsigned long addr)
+{
+	struct rb_node *rb_node;
+	struct vm_area_struct *vma = NULL;
+
+	read_lock(&mm->mm_rb_lock);
+	rb_node = mm->mm_rb.rb_node;
+	while (rb_node) {
+		struct vm_area_struct *vma_tmp;
+
+		vma_tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (vma_tmp->vm_end > addr) {
+			vma = vma_tmp;
+			if (vma_tmp->vm_start <= addr)
+				break;
+			rb_node = rb_node->rb_left;
+		} else
+			rb_node = rb_node->rb_right;
+	}
+	read_unlock(&mm->mm_rb_lock);
+	return vma;
+}
+#endif
+
 /*
  * Same as find_vma, but also return a pointer to the previous VMA in *pprev.
  */
@@ -1966,9 +2034,11 @@ static void unmap_region(struct mm_struct *mm,
 	update_hiwater_rss(mm);
 	unmap_vmas(&tlb, vma, start, end, &nr_accounted, NULL);
 	vm_unacct_memory(nr_accounted);
+	mm_spf_block(mm);
 	free_pgtables(&tlb, vma, prev ? prev->vm_end : FIRST_USER_ADDRESS,
 				 next ? next->vm_start : 0);
 	tlb_finish_mmu(&tlb, start, end);
+	mm_spf_unblock(mm);
 }
 
 /*
@@ -1985,12 +2055,16 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
+	mm_rb_write_lock(mm);
 	do {
+		/* The vma is going away: fail any speculative fault on it */
+		vma_write_begin(vma);
 		rb_erase(&vma->vm_rb, &mm->mm_rb);
 		mm->map_count--;
 		tail_vma = vma;
 		vma = vma->vm_next;
 	} while (vma && vma->vm_start < end);
+	mm_rb_write_unlock(mm);
 	*insertion_point = vma;
 	if (vma)
 		vma->vm_prev = prev;
@@ -60,6 +60,7 @@
 #include <linux/mm_inline.h>
 #include <linux/migrate.h>
 #include <linux/page-debug-flags.h>
+#include <linux/ktime.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -1164,7 +1165,7 @@ static struct page *__rmqueue_cma(struct zone *zone, unsigned int order,
 {
 	struct page *page = 0;
 #ifdef CONFIG_CMA
-	if (migratetype == MIGRATE_MOVABLE && !zone->cma_alloc)
+	if (migratetype == MIGRATE_MOVABLE && !atomic_read(&zone->cma_alloc))
 		page = __rmqueue_smallest(zone, order, MIGRATE_CMA);
 	if (!page)
 #endif
@@ -1382,36 +1383,21 @@ void mark_free_pages(struct zone *zone)
 #endif /* CONFIG_PM */
 
 /*
- * Free a 0-order page
- * cold == 1 ? free a cold page : free a hot page
+ * Put a prepared 0-order page on this CPU's pcp lists, or straight
+ * back to the buddy allocator if it sits in an isolated or CMA
+ * pageblock.  Must be called with interrupts disabled.
+ *
+ * *locked caches a held zone->lock between calls, so that a run of
+ * buddy-bound pages from one zone takes the lock only once.  The
+ * caller drops it when done.
  */
-void free_hot_cold_page(struct page *page, int cold)
+static void __free_hot_cold_page(struct page *page, int cold,
+				 struct zone **locked)
 {
 	struct zone *zone = page_zone(page);
 	struct per_cpu_pages *pcp;
-	unsigned long flags;
-	int migratetype;
-	int wasMlocked = __TestClearPageMlocked(page);
-
-#ifdef CONFIG_SCFS_LOWER_PAGECACHE_INVALIDATION
-	/*
-	   struct scfs_sb_info *sbi;
-
-	   if (PageScfslower(page) || PageNocache(page)) {
-	   sbi = SCFS_S(page->mapping->host->i_sb);
-	   sbi->scfs_lowerpage_reclaim_count++;
-	   }
-	 */
-#endif
-
-	if (!free_pages_prepare(page, 0))
-		return;
+	int migratetype = get_freepage_migratetype(page);
 
-	migratetype = get_pageblock_migratetype(page);
-	set_freepage_migratetype(page, migratetype);
-	local_irq_save(flags);
-	if (unlikely(wasMlocked))
-		free_page_mlock(page);
 	__count_vm_event(PGFREE);
 
 	/*
@@ -1424,8 +1410,17 @@ void free_hot_cold_page(struct page *page, int cold)
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(migratetype == MIGRATE_ISOLATE) ||
 			     is_migrate_cma(migratetype)) {
-			free_one_page(zone, page, 0, migratetype);
-			goto out;
+			if (*locked != zone) {
+				if (*locked)
+					spin_unlock(&(*locked)->lock);
+				spin_lock(&zone->lock);
+				*locked = zone;
+			}
+			zone->pages_scanned = 0;
+			__free_one_page(page, zone, 0, migratetype);
+			if (unlikely(migratetype != MIGRATE_ISOLATE))
+				__mod_zone_freepage_state(zone, 1, migratetype);
+			return;
 		}
 		migratetype = MIGRATE_MOVABLE;
 	}
@@ -1437,26 +1432,128 @@ void free_hot_cold_page(struct page *page, int cold)
 		list_add(&page->lru, &pcp->lists[migratetype]);
 	pcp->count++;
 	if (pcp->count >= pcp->high) {
+		/* free_pcppages_bulk() takes zone->lock itself */
+		if (*locked) {
+			spin_unlock(&(*locked)->lock);
+			*locked = NULL;
+		}
 		free_pcppages_bulk(zone, pcp->batch, pcp);
 		pcp->count -= pcp->batch;
 	}
+}
 
-out:
+/*
+ * Free a 0-order page
+ * cold == 1 ? free a cold page : free a hot page
+ */
+void free_hot_cold_page(struct page *page, int cold)
+{
+	struct zone *locked = NULL;
+	unsigned long flags;
+	int wasMlocked = __TestClearPageMlocked(page);
+
+#ifdef CONFIG_SCFS_LOWER_PAGECACHE_INVALIDATION
+	/*
+	   struct scfs_sb_info *sbi;
+
+	   if (PageScfslower(page) || PageNocache(page)) {
+	   sbi = SCFS_S(page->mapping->host->i_sb);
+	   sbi->scfs_lowerpage_reclaim_count++;
+	   }
+	 */
+#endif
+
+	if (!free_pages_prepare(page, 0))
+		return;
+
+	set_freepage_migratetype(page, get_pageblock_migratetype(page));
+	local_irq_save(flags);
+	if (unlikely(wasMlocked))
+		free_page_mlock(page);
+	__free_hot_cold_page(page, cold, &locked);
+	if (locked)
+		spin_unlock(&locked->lock);
 	local_irq_restore(flags);
 }
 
+/*
+ * Pages freed by free_hot_cold_page_list() between two interrupt
+ * enable points, to bound the irq-off section for long lists.
+ */
+#define FREE_PAGE_LIST_BATCH	SWAP_CLUSTER_MAX
+
 /*
  * Free a list of 0-order pages
+ *
+ * Interrupts are disabled once per FREE_PAGE_LIST_BATCH pages instead
+ * of once per page, and pages that bypass the pcp lists share a single
+ * zone->lock hold per zone.
  */
 void free_hot_cold_page_list(struct list_head *list, int cold)
 {
 	struct page *page, *next;
+	struct zone *locked = NULL;
+	unsigned long flags;
+	int batch = 0;
 
+	list_for_each_entry_safe(page, next, list, lru) {
+		int wasMlocked = __TestClearPageMlocked(page);
+
+		if (!free_pages_prepare(page, 0)) {
+			list_del(&page->lru);
+			continue;
+		}
+		set_freepage_migratetype(page,
+					 get_pageblock_migratetype(page));
+		if (unlikely(wasMlocked)) {
+			local_irq_save(flags);
+			free_page_mlock(page);
+			local_irq_restore(flags);
+		}
+	}
+
+	local_irq_save(flags);
 	list_for_each_entry_safe(page, next, list, lru) {
 		trace_mm_page_free_batched(page, cold);
-		free_hot_cold_page(page, cold);
+		__free_hot_cold_page(page, cold, &locked);
+
+		if (++batch == FREE_PAGE_LIST_BATCH) {
+			if (locked) {
+				spin_unlock(&locked->lock);
+				locked = NULL;
+			}
+			local_irq_restore(flags);
+			batch = 0;
+			local_irq_save(flags);
+		}
+	}
+	if (locked)
+		spin_unlock(&locked->lock);
+	local_irq_restore(flags);
+}
+
+/**
+ * free_page_list - drop a reference on each page of a list
+ * @list: 0-order pages linked through page->lru
+ *
+ * Equivalent to calling __free_page() on every page of @list, but the
+ * pages that become free go through free_hot_cold_page_list() as one
+ * batch.  The pages must not be compound and their ->lru must not be
+ * used for anything else.  @list is empty on return.
+ */
+void free_page_list(struct list_head *list)
+{
+	struct page *page, *next;
+
+	list_for_each_entry_safe(page, next, list, lru) {
+		VM_BUG_ON(PageCompound(page));
+		if (!put_page_testzero(page))
+			list_del(&page->lru);
 	}
+	free_hot_cold_page_list(list, 0);
+	INIT_LIST_HEAD(list);
 }
+EXPORT_SYMBOL(free_page_list);
 
 /*
  * split_page takes a non-compound higher-order page, and splits it into
@@ -2269,6 +2366,7 @@ __perform_reclaim(gfp_t gfp_mask, unsigned int order, struct zonelist *zonelist,
 {
 	struct reclaim_state reclaim_state;
 	int progress;
+	ktime_t start;
 
 	cond_resched();
 
@@ -2279,7 +2377,10 @@ __perform_reclaim(gfp_t gfp_mask, unsigned int order, struct zonelist *zonelist,
 	reclaim_state.reclaimed_slab = 0;
 	current->reclaim_state = &reclaim_state;
 
+	start = ktime_get();
 	progress = try_to_free_pages(zonelist, order, gfp_mask, nodemask);
+	/* Total time allocators spent stalled in direct reclaim */
+	count_vm_events(ALLOCSTALL_US, ktime_us_delta(ktime_get(), start));
 
 	current->reclaim_state = NULL;
 	lockdep_clear_current_reclaim_state();
@@ -4645,6 +4746,8 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat_resize_init(pgdat);
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
+	mutex_init(&pgdat->kswapd_awake_lock);
+	spin_lock_init(&pgdat->kswapd_req_lock);
 	pgdat->kswapd_max_order = 0;
 	pgdat_page_cgroup_init(pgdat);
 
@@ -6042,6 +6145,8 @@ int alloc_contig_range(unsigned long start, unsigned long end,
 	};
 	INIT_LIST_HEAD(&cc.migratepages);
 
+	atomic_inc(&zone->cma_alloc);
+
 	/*
 	 * What we do here is we mark all pageblocks in range as
 	 * MIGRATE_ISOLATE.  Because pageblock and max order pages may
@@ -6071,8 +6176,6 @@ int alloc_contig_range(unsigned long start, unsigned long end,
 	if (ret)
 		goto done;
 
-	zone->cma_alloc = 1;
-
 	ret = __alloc_contig_migrate_range(&cc, start, end);
 	if (ret)
 		goto done;
@@ -6132,10 +6235,68 @@ int alloc_contig_range(unsigned long start, unsigned long end,
 done:
 	undo_isolate_page_range(pfn_max_align_down(start),
 				pfn_max_align_up(end), migratetype);
-	zone->cma_alloc = 0;
+	atomic_dec(&zone->cma_alloc);
 	return ret;
 }
 
+/**
+ * drain_contig_range() -- migrate movable pages out of a range
+ * @start:	start PFN to drain
+ * @end:	one-past-the-last PFN to drain
+ * @migratetype:	migratetype of the underlaying pageblocks, as for
+ *			alloc_contig_range()
+ *
+ * Does the migration half of alloc_contig_range() ahead of time, so
+ * that a later alloc_contig_range() on the same range finds the pages
+ * already free.  The pages are put back to the page allocator, so the
+ * caller should hold movable allocations off the zone's CMA pageblocks
+ * with cma_hold_movable() until the range is allocated.
+ *
+ * The same constraints as for alloc_contig_range() apply.
+ *
+ * Returns zero on success or negative error code.
+ */
+int drain_contig_range(unsigned long start, unsigned long end,
+		       unsigned migratetype)
+{
+	int ret;
+
+	struct compact_control cc = {
+		.nr_migratepages = 0,
+		.order = -1,
+		.zone = page_zone(pfn_to_page(start)),
+		.sync = true,
+		.ignore_skip_hint = true,
+	};
+	INIT_LIST_HEAD(&cc.migratepages);
+
+	ret = start_isolate_page_range(pfn_max_align_down(start),
+				       pfn_max_align_up(end), migratetype);
+	if (ret)
+		return ret;
+
+	ret = __alloc_contig_migrate_range(&cc, start, end);
+
+	undo_isolate_page_range(pfn_max_align_down(start),
+				pfn_max_align_up(end), migratetype);
+	return ret;
+}
+
+/*
+ * Keep movable allocations off the CMA pageblocks of @pfn's zone, so
+ * pages drained by drain_contig_range() stay free.  Calls nest and
+ * must be balanced by cma_release_movable().
+ */
+void cma_hold_movable(unsigned long pfn)
+{
+	atomic_inc(&page_zone(pfn_to_page(pfn))->cma_alloc);
+}
+
+void cma_release_movable(unsigned long pfn)
+{
+	atomic_dec(&page_zone(pfn_to_page(pfn))->cma_alloc);
+}
+
 void free_contig_range(unsigned long pfn, unsigned nr_pages)
 {
 	unsigned int count = 0;
@@ -18,6 +18,14 @@
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
 
+#ifdef CONFIG_READAHEAD_HISTORY
+#define CREATE_TRACE_POINTS
+#include <trace/events/readahead.h>
+#else
+#define trace_readahead_window(mapping, offset, req_size, start, size, async) \
+	do { } while (0)
+#endif
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -180,7 +188,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		rcu_read_lock();
 		page = radix_tree_lookup(&mapping->page_tree, page_offset);
 		rcu_read_unlock();
-		if (page)
+		if (page && !radix_tree_exceptional_entry(page))
 			continue;
 
 		page = page_cache_alloc_readahead(mapping);
@@ -198,11 +206,12 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 
 		page->index = page_offset;
 
-		page->flags |= (1L << PG_readahead);
-
 		list_add(&page->lru, &page_pool);
 		if (page_idx == nr_to_read - lookahead_size)
 			SetPageReadahead(page);
+		/* Only the lookahead part is read speculatively */
+		if (page_idx >= nr_to_read - lookahead_size)
+			__SetPageReadaheadWindow(page);
 		ret++;
 	}
 
@@ -367,12 +376,88 @@ static pgoff_t count_history_pages(struct address_space *mapping,
 	pgoff_t head;
 
 	rcu_read_lock();
-	head = radix_tree_prev_hole(&mapping->page_tree, offset - 1, max);
+	head = page_cache_prev_hole(mapping, offset - 1, max);
 	rcu_read_unlock();
 
 	return offset - 1 - head;
 }
 
+#ifdef CONFIG_READAHEAD_HISTORY
+/*
+ * Per-file readahead history.
+ *
+ * The mapping remembers how many readahead pages ended up being used
+ * (hits) or were dropped from the page cache unused (misses), and how
+ * often ondemand_readahead() saw a stream or a random read.  Unlike
+ * file_ra_state it survives close/open, and goes away with the inode.
+ *
+ * Updates are not serialised: this is only a sizing hint, and a lost
+ * increment does no harm.
+ */
+#define RA_HISTORY_MAX	4096	/* halve a pair of counters past this */
+#define RA_HISTORY_MIN	64	/* samples needed before trusting it */
+
+static inline void ra_history_inc(unsigned short *a, unsigned short *b)
+{
+	if (++*a + *b >= RA_HISTORY_MAX) {
+		*a >>= 1;
+		*b >>= 1;
+	}
+}
+
+void ra_history_account(struct address_space *mapping, bool hit)
+{
+	struct ra_history *h = &mapping->ra_history;
+
+	if (hit)
+		ra_history_inc(&h->hits, &h->misses);
+	else
+		ra_history_inc(&h->misses, &h->hits);
+}
+
+static void ra_history_pattern(struct address_space *mapping, bool seq)
+{
+	struct ra_history *h = &mapping->ra_history;
+
+	if (seq)
+		ra_history_inc(&h->seq, &h->random);
+	else
+		ra_history_inc(&h->random, &h->seq);
+}
+
+/*
+ * Size a fresh readahead window from the file's history: files whose
+ * readahead is mostly wasted on random reads only get what was asked
+ * for, files whose readahead is nearly always used start at full size
+ * instead of ramping up.
+ */
+static void ra_history_init_window(struct address_space *mapping,
+				   struct file_ra_state *ra,
+				   unsigned long req_size, unsigned long max)
+{
+	struct ra_history *h = &mapping->ra_history;
+	unsigned int hits = h->hits, misses = h->misses;
+
+	if (hits + misses < RA_HISTORY_MIN)
+		return;
+
+	if (misses > hits && h->random > h->seq) {
+		ra->size = min(req_size, ra->size);
+		ra->async_size = 0;
+	} else if (hits >= 8 * misses && req_size < max) {
+		ra->size = max;
+		ra->async_size = max - req_size;
+	}
+}
+#else
+static inline void ra_history_pattern(struct address_space *mapping,
+				      bool seq) {}
+static inline void ra_history_init_window(struct address_space *mapping,
+					  struct file_ra_state *ra,
+					  unsigned long req_size,
+					  unsigned long max) {}
+#endif
+
 /*
  * page cache context based read-ahead
  */
@@ -446,7 +531,7 @@ ondemand_readahead(struct address_space *mapping,
 		pgoff_t start;
 
 		rcu_read_lock();
-		start = radix_tree_next_hole(&mapping->page_tree, offset+1,max);
+		start = page_cache_next_hole(mapping, offset + 1, max);
 		rcu_read_unlock();
 
 		if (!start || start - offset > max)
@@ -483,14 +568,18 @@ ondemand_readahead(struct address_space *mapping,
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
+	ra_history_pattern(mapping, false);
+	trace_readahead_window(mapping, offset, req_size, offset, req_size, 0);
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
+	ra_history_init_window(mapping, ra, req_size, max);
 
 readit:
+	ra_history_pattern(mapping, true);
 	/*
 	 * Will this read hit the readahead marker made by itself?
 	 * If so, trigger the readahead marker hit now, and merge
@@ -501,6 +590,8 @@ readit:
 		ra->size += ra->async_size;
 	}
 
+	trace_readahead_window(mapping, offset, req_size,
+			       ra->start, ra->size, ra->async_size);
 	return ra_submit(ra, mapping, filp);
 }
 
@@ -391,6 +391,16 @@ static void shmem_deswap_pagevec(struct pagevec *pvec)
 	pvec->nr = j;
 }
 
+/*
+ * Only shmem/tmpfs mappings keep swap entries in their page cache slots;
+ * exceptional entries found anywhere else are reclaim's shadow entries.
+ */
+bool shmem_mapping(struct address_space *mapping)
+{
+	return mapping->a_ops == &shmem_aops;
+}
+EXPORT_SYMBOL_GPL(shmem_mapping);
+
 /*
  * SysV IPC SHM_UNLOCK restore Unevictable pages to their evictable lists.
  */
@@ -886,7 +896,7 @@ static int shmem_getpage_gfp(struct inode *inode, pgoff_t index,
 		return -EFBIG;
 repeat:
 	swap.val = 0;
-	page = find_lock_page(mapping, index);
+	page = find_lock_entry(mapping, index);
 	if (radix_tree_exceptional_entry(page)) {
 		swap = radix_to_swp_entry(page);
 		page = NULL;
@@ -1034,7 +1044,7 @@ unacct:
 	shmem_unacct_blocks(info->flags, 1);
 failed:
 	if (swap.val && error != -EINVAL) {
-		struct page *test = find_get_page(mapping, index);
+		struct page *test = find_get_entry(mapping, index);
 		if (test && !radix_tree_exceptional_entry(test))
 			page_cache_release(test);
 		/* Have another try if the entry has changed */
@@ -2549,6 +2559,12 @@ int shmem_lock(struct file *file, int lock, struct user_struct *user)
 	return 0;
 }
 
+bool shmem_mapping(struct address_space *mapping)
+{
+	return false;
+}
+EXPORT_SYMBOL_GPL(shmem_mapping);
+
 void shmem_unlock_mapping(struct address_space *mapping)
 {
 }
@@ -214,12 +214,12 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	int i;
 
 	cleancache_invalidate_inode(mapping);
-	if (mapping->nrpages == 0)
-		return;
-
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
 	end = (lend >> PAGE_CACHE_SHIFT);
 
+	if (mapping->nrpages == 0)
+		goto shadows;
+
 	pagevec_init(&pvec, 0);
 	index = start;
 	while (index <= end && pagevec_lookup(&pvec, mapping, index,
@@ -293,9 +293,83 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		index++;
 	}
 	cleancache_invalidate_inode(mapping);
+shadows:
+	clear_shadow_entries(mapping, start, end);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
+static void clear_shadow_entry(struct address_space *mapping, pgoff_t index)
+{
+	struct radix_tree_node *node;
+	void **slot;
+
+	if (!__radix_tree_lookup(&mapping->page_tree, index, &node, &slot))
+		return;
+	radix_tree_replace_slot(slot, NULL);
+	mapping->nrshadows--;
+	if (!node)
+		return;
+	workingset_node_shadows_dec(node);
+	/*
+	 * Don't track node without shadow entries.
+	 *
+	 * Avoid acquiring the list_lru lock if already untracked.
+	 * The list_empty() test is safe as node->private_list is
+	 * protected by mapping->tree_lock.
+	 */
+	if (!workingset_node_shadows(node) &&
+	    !list_empty(&node->private_list))
+		list_lru_del(&workingset_shadow_nodes, &node->private_list);
+	__radix_tree_delete_node(&mapping->page_tree, node);
+}
+
+/**
+ * clear_shadow_entries - remove shadow entries from a mapping
+ * @mapping: mapping to clean up
+ * @start: first page index to look at
+ * @end: last page index to look at (inclusive)
+ *
+ * Page reclaim leaves shadow entries in the slots of evicted pages (see
+ * mm/workingset.c).  They are not pages, so the truncation loops above
+ * never see them; this drops the ones in the given range.
+ */
+void clear_shadow_entries(struct address_space *mapping,
+			  pgoff_t start, pgoff_t end)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned int i, nr, nr_shadows;
+	pgoff_t next;
+
+	while (mapping->nrshadows && start <= end) {
+		spin_lock_irq(&mapping->tree_lock);
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, start, PAGEVEC_SIZE);
+		next = nr ? indices[nr - 1] + 1 : 0;
+		/*
+		 * Pick the shadows first: deleting an entry may free
+		 * radix tree nodes that later slots point into.
+		 */
+		nr_shadows = 0;
+		for (i = 0; i < nr && indices[i] <= end; i++) {
+			void *entry;
+
+			entry = radix_tree_deref_slot_protected(slots[i],
+						&mapping->tree_lock);
+			if (radix_tree_exceptional_entry(entry))
+				indices[nr_shadows++] = indices[i];
+		}
+		for (i = 0; i < nr_shadows; i++)
+			clear_shadow_entry(mapping, indices[i]);
+		spin_unlock_irq(&mapping->tree_lock);
+
+		if (nr < PAGEVEC_SIZE || !next)
+			break;
+		start = next;
+		cond_resched();
+	}
+}
+
 /**
  * truncate_inode_pages - truncate *all* the pages from an offset
  * @mapping: mapping to truncate
@@ -400,7 +474,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__delete_from_page_cache(page);
+	__delete_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
@@ -1610,14 +1610,16 @@ static void __vunmap(const void *addr, int deallocate_pages)
 	debug_check_no_obj_freed(addr, area->size);
 
 	if (deallocate_pages) {
+		LIST_HEAD(pages);
 		int i;
 
 		for (i = 0; i < area->nr_pages; i++) {
 			struct page *page = area->pages[i];
 
 			BUG_ON(!page);
-			__free_page(page);
+			list_add(&page->lru, &pages);
 		}
+		free_page_list(&pages);
 
 		if (area->flags & VM_VPAGES)
 			vfree(area->pages);
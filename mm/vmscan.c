@@ -47,6 +47,7 @@
 #include <asm/div64.h>
 
 #include <linux/swapops.h>
+#include <linux/vmpressure.h>
 
 #include "internal.h"
 
@@ -224,37 +225,184 @@ static unsigned long zone_nr_lru_pages(struct mem_cgroup_zone *mz,
 
 
 /*
- * Add a shrinker callback to be called from the vm
+ * Add a shrinker callback to be called from the vm.
  */
-void register_shrinker(struct shrinker *shrinker)
+int register_shrinker(struct shrinker *shrinker)
 {
-	atomic_long_set(&shrinker->nr_in_batch, 0);
+	size_t size = sizeof(*shrinker->nr_deferred);
+
+	/*
+	 * If we only have one possible node in the system anyway, save
+	 * ourselves the trouble and disable NUMA aware behavior. This way we
+	 * will save memory and some small loop time later.
+	 */
+	if (nr_node_ids == 1)
+		shrinker->flags &= ~SHRINKER_NUMA_AWARE;
+
+	if (shrinker->flags & SHRINKER_NUMA_AWARE)
+		size *= nr_node_ids;
+
+	shrinker->nr_deferred = kzalloc(size, GFP_KERNEL);
+	if (!shrinker->nr_deferred)
+		return -ENOMEM;
+
 	down_write(&shrinker_rwsem);
 	list_add_tail(&shrinker->list, &shrinker_list);
 	up_write(&shrinker_rwsem);
+	return 0;
 }
 EXPORT_SYMBOL(register_shrinker);
 
 /*
- * Remove one
+ * Remove one.  A shrinker whose registration failed was never added to
+ * the list, so there is nothing to remove.
  */
 void unregister_shrinker(struct shrinker *shrinker)
 {
+	if (!shrinker->nr_deferred)
+		return;
 	down_write(&shrinker_rwsem);
 	list_del(&shrinker->list);
 	up_write(&shrinker_rwsem);
+	kfree(shrinker->nr_deferred);
+	shrinker->nr_deferred = NULL;
 }
 EXPORT_SYMBOL(unregister_shrinker);
 
-static inline int do_shrinker_shrink(struct shrinker *shrinker,
-				     struct shrink_control *sc,
-				     unsigned long nr_to_scan)
+/*
+ * Shrinkers that still implement the old single ->shrink() callback are
+ * driven through these two helpers, which map it onto the count/scan
+ * interface.
+ */
+static unsigned long shrinker_count(struct shrinker *shrinker,
+				    struct shrink_control *sc)
+{
+	int count;
+
+	if (shrinker->count_objects)
+		return shrinker->count_objects(shrinker, sc);
+
+	sc->nr_to_scan = 0;
+	count = (*shrinker->shrink)(shrinker, sc);
+	return count > 0 ? count : 0;
+}
+
+static unsigned long shrinker_scan(struct shrinker *shrinker,
+				   struct shrink_control *sc)
 {
+	unsigned long nr_to_scan = sc->nr_to_scan;
+	int nr_before, nr_after;
+
+	if (shrinker->scan_objects)
+		return shrinker->scan_objects(shrinker, sc);
+
+	sc->nr_to_scan = 0;
+	nr_before = (*shrinker->shrink)(shrinker, sc);
 	sc->nr_to_scan = nr_to_scan;
-	return (*shrinker->shrink)(shrinker, sc);
+	nr_after = (*shrinker->shrink)(shrinker, sc);
+	if (nr_after == -1)
+		return SHRINK_STOP;
+	return nr_after < nr_before ? nr_before - nr_after : 0;
 }
 
 #define SHRINK_BATCH 128
+
+static unsigned long
+shrink_slab_node(struct shrink_control *shrinkctl, struct shrinker *shrinker,
+		 unsigned long nr_pages_scanned, unsigned long lru_pages)
+{
+	unsigned long freed = 0;
+	unsigned long long delta;
+	long total_scan;
+	long max_pass;
+	long nr;
+	long new_nr;
+	int nid = shrinkctl->nid;
+	long batch_size = shrinker->batch ? shrinker->batch
+					  : SHRINK_BATCH;
+
+	max_pass = shrinker_count(shrinker, shrinkctl);
+	if (max_pass == 0)
+		return 0;
+
+	/*
+	 * copy the current shrinker scan count into a local variable
+	 * and zero it so that other concurrent shrinker invocations
+	 * don't also do this scanning work.
+	 */
+	nr = atomic_long_xchg(&shrinker->nr_deferred[nid], 0);
+
+	total_scan = nr;
+	delta = (4 * nr_pages_scanned) / shrinker->seeks;
+	delta *= max_pass;
+	do_div(delta, lru_pages + 1);
+	total_scan += delta;
+	if (total_scan < 0) {
+		printk(KERN_ERR
+		"shrink_slab: %pF negative objects to delete nr=%ld\n",
+		       shrinker->scan_objects ?
+		       (void *)shrinker->scan_objects : (void *)shrinker->shrink,
+		       total_scan);
+		total_scan = max_pass;
+	}
+
+	/*
+	 * We need to avoid excessive windup on filesystem shrinkers
+	 * due to large numbers of GFP_NOFS allocations causing the
+	 * shrinkers to return -1 all the time. This results in a large
+	 * nr being built up so when a shrink that can do some work
+	 * comes along it empties the entire cache due to nr >>>
+	 * max_pass.  This is bad for sustaining a working set in
+	 * memory.
+	 *
+	 * Hence only allow the shrinker to scan the entire cache when
+	 * a large delta change is calculated directly.
+	 */
+	if (delta < max_pass / 4)
+		total_scan = min(total_scan, max_pass / 2);
+
+	/*
+	 * Avoid risking looping forever due to too large nr value:
+	 * never try to free more than twice the estimate number of
+	 * freeable entries.
+	 */
+	if (total_scan > max_pass * 2)
+		total_scan = max_pass * 2;
+
+	trace_mm_shrink_slab_start(shrinker, shrinkctl, nr,
+				nr_pages_scanned, lru_pages,
+				max_pass, delta, total_scan);
+
+	while (total_scan >= batch_size) {
+		unsigned long ret;
+
+		shrinkctl->nr_to_scan = batch_size;
+		ret = shrinker_scan(shrinker, shrinkctl);
+		if (ret == SHRINK_STOP)
+			break;
+		freed += ret;
+
+		count_vm_events(SLABS_SCANNED, batch_size);
+		total_scan -= ret > batch_size ? ret : batch_size;
+
+		cond_resched();
+	}
+
+	/*
+	 * move the unused scan count back into the shrinker in a
+	 * manner that handles concurrent updates. If we exhausted the
+	 * scan, there is no need to do an update.
+	 */
+	if (total_scan > 0)
+		new_nr = atomic_long_add_return(total_scan,
+						&shrinker->nr_deferred[nid]);
+	else
+		new_nr = atomic_long_read(&shrinker->nr_deferred[nid]);
+
+	trace_mm_shrink_slab_end(shrinker, freed, nr, new_nr);
+	return freed;
+}
+
 /*
  * Call the shrink functions to age shrinkable caches
  *
@@ -272,121 +420,58 @@ static inline int do_shrinker_shrink(struct shrinker *shrinker,
  * are eligible for the caller's allocation attempt.  It is used for balancing
  * slab reclaim versus page reclaim.
  *
+ * NUMA aware shrinkers are called once for every node in
+ * @shrinkctl->nodes_to_scan, everything else is called once with nid 0.
+ * When @shrinkctl->memcg is set, only memcg aware shrinkers are called:
+ * the caches of the other shrinkers are not charged to any memcg, so
+ * shrinking them cannot relieve the pressured cgroup.
+ *
  * Returns the number of slab objects which we shrunk.
  */
-unsigned long shrink_slab(struct shrink_control *shrink,
+unsigned long shrink_slab(struct shrink_control *shrinkctl,
 			  unsigned long nr_pages_scanned,
 			  unsigned long lru_pages)
 {
 	struct shrinker *shrinker;
-	unsigned long ret = 0;
+	unsigned long freed = 0;
 
 	if (nr_pages_scanned == 0)
 		nr_pages_scanned = SWAP_CLUSTER_MAX;
 
 	if (!down_read_trylock(&shrinker_rwsem)) {
-		/* Assume we'll be able to shrink next time */
-		ret = 1;
+		/*
+		 * If we would return 0, our callers would understand that we
+		 * have nothing else to shrink and give up trying. By returning
+		 * 1 we keep it going and assume we'll be able to shrink next
+		 * time.
+		 */
+		freed = 1;
 		goto out;
 	}
 
 	list_for_each_entry(shrinker, &shrinker_list, list) {
-		unsigned long long delta;
-		long total_scan, pages_got;
-		long max_pass;
-		int shrink_ret = 0;
-		long nr;
-		long new_nr;
-		long batch_size = shrinker->batch ? shrinker->batch
-						  : SHRINK_BATCH;
-
-		max_pass = do_shrinker_shrink(shrinker, shrink, 0);
-		if (max_pass <= 0)
+		if (shrinkctl->memcg &&
+		    !(shrinker->flags & SHRINKER_MEMCG_AWARE))
 			continue;
 
-		/*
-		 * copy the current shrinker scan count into a local variable
-		 * and zero it so that other concurrent shrinker invocations
-		 * don't also do this scanning work.
-		 */
-		nr = atomic_long_xchg(&shrinker->nr_in_batch, 0);
-
-		total_scan = nr;
-		delta = (4 * nr_pages_scanned) / shrinker->seeks;
-		delta *= max_pass;
-		do_div(delta, lru_pages + 1);
-		total_scan += delta;
-		if (total_scan < 0) {
-			printk(KERN_ERR "shrink_slab: %pF negative objects to "
-			       "delete nr=%ld\n",
-			       shrinker->shrink, total_scan);
-			total_scan = max_pass;
+		if (!(shrinker->flags & SHRINKER_NUMA_AWARE)) {
+			shrinkctl->nid = 0;
+			freed += shrink_slab_node(shrinkctl, shrinker,
+					nr_pages_scanned, lru_pages);
+			continue;
 		}
 
-		/*
-		 * We need to avoid excessive windup on filesystem shrinkers
-		 * due to large numbers of GFP_NOFS allocations causing the
-		 * shrinkers to return -1 all the time. This results in a large
-		 * nr being built up so when a shrink that can do some work
-		 * comes along it empties the entire cache due to nr >>>
-		 * max_pass.  This is bad for sustaining a working set in
-		 * memory.
-		 *
-		 * Hence only allow the shrinker to scan the entire cache when
-		 * a large delta change is calculated directly.
-		 */
-		if (delta < max_pass / 4)
-			total_scan = min(total_scan, max_pass / 2);
-
-		/*
-		 * Avoid risking looping forever due to too large nr value:
-		 * never try to free more than twice the estimate number of
-		 * freeable entries.
-		 */
-		if (total_scan > max_pass * 2)
-			total_scan = max_pass * 2;
-
-		trace_mm_shrink_slab_start(shrinker, shrink, nr,
-					nr_pages_scanned, lru_pages,
-					max_pass, delta, total_scan);
-
-		while (total_scan >= batch_size) {
-			int nr_before;
-
-			nr_before = do_shrinker_shrink(shrinker, shrink, 0);
-			shrink_ret = do_shrinker_shrink(shrinker, shrink,
-							batch_size);
-			if (shrink_ret == -1)
-				break;
-			if (shrink_ret < nr_before) {
-				pages_got = nr_before - shrink_ret;
-				ret += pages_got;
-				total_scan -= pages_got > batch_size ? pages_got : batch_size;
-			} else {
-				total_scan -= batch_size;
-			}
-			count_vm_events(SLABS_SCANNED, batch_size);
+		for_each_node_mask(shrinkctl->nid, shrinkctl->nodes_to_scan) {
+			if (node_online(shrinkctl->nid))
+				freed += shrink_slab_node(shrinkctl, shrinker,
+						nr_pages_scanned, lru_pages);
 
-			cond_resched();
 		}
-
-		/*
-		 * move the unused scan count back into the shrinker in a
-		 * manner that handles concurrent updates. If we exhausted the
-		 * scan, there is no need to do an update.
-		 */
-		if (total_scan > 0)
-			new_nr = atomic_long_add_return(total_scan,
-					&shrinker->nr_in_batch);
-		else
-			new_nr = atomic_long_read(&shrinker->nr_in_batch);
-
-		trace_mm_shrink_slab_end(shrinker, shrink_ret, nr, new_nr);
 	}
 	up_read(&shrinker_rwsem);
 out:
 	cond_resched();
-	return ret;
+	return freed;
 }
 
 static inline int is_page_cache_freeable(struct page *page)
@@ -521,9 +606,11 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
 
 /*
  * Same as remove_mapping, but if the page is removed from the mapping, it
- * gets returned with a refcount of 0.
+ * gets returned with a refcount of 0.  Pages evicted by page reclaim
+ * (@reclaimed) leave a shadow entry behind for refault detection.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -569,10 +656,13 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
 
-		__delete_from_page_cache(page);
+		if (reclaimed && page_is_file_cache(page))
+			shadow = workingset_eviction(mapping, page);
+		__delete_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -595,7 +685,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -778,7 +868,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			goto keep;
 
 		VM_BUG_ON(PageActive(page));
-		VM_BUG_ON(page_zone(page) != zone);
+		VM_BUG_ON(zone && page_zone(page) != zone);
 
 		sc->nr_scanned++;
 
@@ -944,7 +1034,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -992,7 +1082,7 @@ keep:
 	 * back off and wait for congestion to clear because further reclaim
 	 * will encounter the same problem
 	 */
-	if (nr_dirty && nr_dirty == nr_congested && global_reclaim(sc))
+	if (nr_dirty && nr_dirty == nr_congested && global_reclaim(sc) && zone)
 		zone_set_flag(zone, ZONE_CONGESTED);
 
 	free_hot_cold_page_list(&free_pages, 1);
@@ -1031,6 +1121,52 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 	return ret;
 }
 
+#ifdef CONFIG_PROCESS_RECLAIM
+/**
+ * reclaim_pages_from_list - reclaim a list of isolated pages
+ * @page_list: pages isolated from the LRU, possibly from several zones
+ * @nr_scanned: incremented by the number of pages looked at
+ *
+ * Used by /proc/<pid>/reclaim: the pages were picked by walking a task's
+ * page tables, so their recent references are not a reason to keep
+ * them.  Pages that could not be reclaimed are put back on the LRU.
+ *
+ * The batches are small and short-lived, so they are not accounted as
+ * NR_ISOLATED_*.
+ *
+ * Returns the number of reclaimed pages.
+ */
+unsigned long reclaim_pages_from_list(struct list_head *page_list,
+				      unsigned long *nr_scanned)
+{
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.priority = DEF_PRIORITY,
+		.may_writepage = 1,
+		.may_unmap = 1,
+		.may_swap = 1,
+	};
+	unsigned long nr_reclaimed, dummy1 = 0, dummy2 = 0;
+	struct page *page;
+
+	list_for_each_entry(page, page_list, lru)
+		ClearPageActive(page);
+
+	nr_reclaimed = shrink_page_list(page_list, NULL, &sc,
+					TTU_UNMAP|TTU_IGNORE_ACCESS,
+					&dummy1, &dummy2, true);
+	*nr_scanned += sc.nr_scanned;
+
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		list_del(&page->lru);
+		putback_lru_page(page);
+	}
+
+	return nr_reclaimed;
+}
+#endif /* CONFIG_PROCESS_RECLAIM */
+
 /*
  * Attempt to remove the specified page from its LRU.  Only take this page
  * if it is of the appropriate PageActive status.  Pages which are being
@@ -2023,6 +2159,8 @@ static void shrink_zone(struct zone *zone, struct scan_control *sc)
 		.priority = sc->priority,
 	};
 	struct mem_cgroup *memcg;
+	unsigned long nr_reclaimed = sc->nr_reclaimed;
+	unsigned long nr_scanned = sc->nr_scanned;
 
 	memcg = mem_cgroup_iter(root, NULL, &reclaim);
 	do {
@@ -2048,6 +2186,10 @@ static void shrink_zone(struct zone *zone, struct scan_control *sc)
 		}
 		memcg = mem_cgroup_iter(root, memcg, &reclaim);
 	} while (memcg);
+
+	vmpressure(sc->gfp_mask, sc->target_mem_cgroup,
+		   sc->nr_scanned - nr_scanned,
+		   sc->nr_reclaimed - nr_reclaimed);
 }
 
 /* Returns true if compaction should go ahead for a high-order request */
@@ -2352,6 +2494,7 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 	struct zoneref *z;
 	struct zone *zone;
 	unsigned long writeback_threshold;
+	unsigned long lru_pages;
 	bool aborted_reclaim;
 
 	delayacct_freepages_start();
@@ -2360,29 +2503,39 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		count_vm_event(ALLOCSTALL);
 
 	do {
+		vmpressure_prio(sc->gfp_mask, sc->target_mem_cgroup,
+				sc->priority);
 		sc->nr_scanned = 0;
 		aborted_reclaim = shrink_zones(zonelist, sc);
 
 		/*
-		 * Don't shrink slabs when reclaiming memory from
-		 * over limit cgroups
+		 * When reclaiming memory from over limit cgroups, only
+		 * the memcg aware shrinkers are asked to help, and the
+		 * slab pressure is balanced against the cgroup's LRUs.
 		 */
-		if (global_reclaim(sc)) {
-			unsigned long lru_pages = 0;
-			for_each_zone_zonelist(zone, z, zonelist,
-					gfp_zone(sc->gfp_mask)) {
-				if (!cpuset_zone_allowed_hardwall(zone, GFP_KERNEL))
-					continue;
+		lru_pages = 0;
+		nodes_clear(shrink->nodes_to_scan);
+		for_each_zone_zonelist(zone, z, zonelist,
+				gfp_zone(sc->gfp_mask)) {
+			if (!cpuset_zone_allowed_hardwall(zone, GFP_KERNEL))
+				continue;
 
+			if (global_reclaim(sc))
 				lru_pages += zone_reclaimable_pages(zone);
-			}
+			else
+				lru_pages += mem_cgroup_zone_nr_lru_pages(
+						sc->target_mem_cgroup,
+						zone_to_nid(zone), zone_idx(zone),
+						LRU_ALL_EVICTABLE);
+			node_set(zone_to_nid(zone), shrink->nodes_to_scan);
+		}
 
-			shrink->priority = sc->priority;
-			shrink_slab(shrink, sc->nr_scanned, lru_pages);
-			if (reclaim_state) {
-				sc->nr_reclaimed += reclaim_state->reclaimed_slab;
-				reclaim_state->reclaimed_slab = 0;
-			}
+		shrink->priority = sc->priority;
+		shrink->memcg = sc->target_mem_cgroup;
+		shrink_slab(shrink, sc->nr_scanned, lru_pages);
+		if (reclaim_state) {
+			sc->nr_reclaimed += reclaim_state->reclaimed_slab;
+			reclaim_state->reclaimed_slab = 0;
 		}
 		total_scanned += sc->nr_scanned;
 		if (sc->nr_reclaimed >= sc->nr_to_reclaim)
@@ -2735,6 +2888,9 @@ static unsigned long balance_pgdat(pg_data_t *pgdat, int order,
 	struct shrink_control shrink = {
 		.gfp_mask = sc.gfp_mask,
 	};
+
+	nodes_clear(shrink.nodes_to_scan);
+	node_set(pgdat->node_id, shrink.nodes_to_scan);
 loop_again:
 	total_scanned = 0;
 	sc.priority = DEF_PRIORITY;
@@ -3001,7 +3157,85 @@ out:
 	return order;
 }
 
-static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
+/*
+ * With several kswapd threads per node, the node only counts as having
+ * kswapd asleep once the last of them has gone to sleep.
+ */
+static void kswapd_account_wake(pg_data_t *pgdat)
+{
+	mutex_lock(&pgdat->kswapd_awake_lock);
+	if (!pgdat->kswapd_awake++) {
+#ifdef CONFIG_RUNTIME_COMPCACHE
+		atomic_set(&kswapd_running, 1);
+#endif /* CONFIG_RUNTIME_COMPCACHE */
+		set_pgdat_percpu_threshold(pgdat, calculate_pressure_threshold);
+	}
+	mutex_unlock(&pgdat->kswapd_awake_lock);
+}
+
+static void kswapd_account_sleep(pg_data_t *pgdat)
+{
+	mutex_lock(&pgdat->kswapd_awake_lock);
+	if (!--pgdat->kswapd_awake) {
+#ifdef CONFIG_RUNTIME_COMPCACHE
+		atomic_set(&kswapd_running, 0);
+#endif /* CONFIG_RUNTIME_COMPCACHE */
+
+		/*
+		 * vmstat counters are not perfectly accurate and the estimated
+		 * value for counters such as NR_FREE_PAGES can deviate from the
+		 * true value by nr_online_cpus * threshold. To avoid the zone
+		 * watermarks being breached while under pressure, we reduce the
+		 * per-cpu vmstat threshold while kswapd is awake and restore
+		 * them before going back to sleep.
+		 */
+		set_pgdat_percpu_threshold(pgdat, calculate_normal_threshold);
+
+		/*
+		 * Compaction records what page blocks it recently failed to
+		 * isolate pages from and skips them in the future scanning.
+		 * When kswapd is going to sleep, it is reasonable to assume
+		 * that pages and compaction may succeed so reset the cache.
+		 */
+		reset_isolation_suitable(pgdat);
+	}
+	mutex_unlock(&pgdat->kswapd_awake_lock);
+}
+
+/*
+ * Read the order and classzone wakeup_kswapd() asked for.  Every request
+ * carries a sequence number, so each kswapd thread of the node sees it
+ * exactly once; it is cleared when the last of them has read it.  A
+ * thread that has already seen the pending request gets "no request".
+ */
+static void kswapd_read_request(pg_data_t *pgdat, unsigned int *seq,
+				unsigned long *order, int *classzone_idx)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pgdat->kswapd_req_lock, flags);
+	if (*seq != pgdat->kswapd_req_seq) {
+		*seq = pgdat->kswapd_req_seq;
+		*order = pgdat->kswapd_max_order;
+		*classzone_idx = pgdat->classzone_idx;
+		if (++pgdat->kswapd_req_readers >= pgdat->kswapd_nr_threads) {
+			pgdat->kswapd_max_order = 0;
+			pgdat->classzone_idx = pgdat->nr_zones - 1;
+		}
+	} else {
+		*order = 0;
+		*classzone_idx = pgdat->nr_zones - 1;
+	}
+	spin_unlock_irqrestore(&pgdat->kswapd_req_lock, flags);
+}
+
+static bool kswapd_request_pending(pg_data_t *pgdat, unsigned int seq)
+{
+	return ACCESS_ONCE(pgdat->kswapd_req_seq) != seq;
+}
+
+static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx,
+				unsigned int seq)
 {
 	long remaining = 0;
 	DEFINE_WAIT(wait);
@@ -3025,38 +3259,30 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
 	if (!sleeping_prematurely(pgdat, order, remaining, classzone_idx)) {
 		trace_mm_vmscan_kswapd_sleep(pgdat->node_id);
 
-#ifdef CONFIG_RUNTIME_COMPCACHE
-		atomic_set(&kswapd_running, 0);
-#endif /* CONFIG_RUNTIME_COMPCACHE */
-
-		/*
-		 * vmstat counters are not perfectly accurate and the estimated
-		 * value for counters such as NR_FREE_PAGES can deviate from the
-		 * true value by nr_online_cpus * threshold. To avoid the zone
-		 * watermarks being breached while under pressure, we reduce the
-		 * per-cpu vmstat threshold while kswapd is awake and restore
-		 * them before going back to sleep.
-		 */
-		set_pgdat_percpu_threshold(pgdat, calculate_normal_threshold);
-
 		/*
-		 * Compaction records what page blocks it recently failed to
-		 * isolate pages from and skips them in the future scanning.
-		 * When kswapd is going to sleep, it is reasonable to assume
-		 * that pages and compaction may succeed so reset the cache.
+		 * The accounting may sleep on a mutex, so it must not run
+		 * between prepare_to_wait() and schedule().  Requests and
+		 * wakeups that came in meanwhile are caught by the checks
+		 * once we are back on the waitqueue.
 		 */
-		reset_isolation_suitable(pgdat);
+		finish_wait(&pgdat->kswapd_wait, &wait);
+		kswapd_account_sleep(pgdat);
+		prepare_to_wait(&pgdat->kswapd_wait, &wait, TASK_INTERRUPTIBLE);
 
-		if (!kthread_should_stop())
+		if (!kthread_should_stop() &&
+		    !kswapd_request_pending(pgdat, seq) &&
+		    !sleeping_prematurely(pgdat, order, remaining, classzone_idx))
 			schedule();
 
-		set_pgdat_percpu_threshold(pgdat, calculate_pressure_threshold);
-	} else {
-		if (remaining)
-			count_vm_event(KSWAPD_LOW_WMARK_HIT_QUICKLY);
-		else
-			count_vm_event(KSWAPD_HIGH_WMARK_HIT_QUICKLY);
+		finish_wait(&pgdat->kswapd_wait, &wait);
+		kswapd_account_wake(pgdat);
+		return;
 	}
+
+	if (remaining)
+		count_vm_event(KSWAPD_LOW_WMARK_HIT_QUICKLY);
+	else
+		count_vm_event(KSWAPD_HIGH_WMARK_HIT_QUICKLY);
 	finish_wait(&pgdat->kswapd_wait, &wait);
 }
 
@@ -3079,6 +3305,7 @@ static int kswapd(void *p)
 	unsigned balanced_order;
 	int classzone_idx, new_classzone_idx;
 	int balanced_classzone_idx;
+	unsigned int req_seq = 0;
 	pg_data_t *pgdat = (pg_data_t*)p;
 	struct task_struct *tsk = current;
 
@@ -3112,6 +3339,7 @@ static int kswapd(void *p)
 	balanced_order = 0;
 	classzone_idx = new_classzone_idx = pgdat->nr_zones - 1;
 	balanced_classzone_idx = classzone_idx;
+	kswapd_account_wake(pgdat);
 	for ( ; ; ) {
 		int ret;
 
@@ -3121,12 +3349,9 @@ static int kswapd(void *p)
 		 * so consider going to sleep on the basis we reclaimed at
 		 */
 		if (balanced_classzone_idx >= new_classzone_idx &&
-					balanced_order == new_order) {
-			new_order = pgdat->kswapd_max_order;
-			new_classzone_idx = pgdat->classzone_idx;
-			pgdat->kswapd_max_order =  0;
-			pgdat->classzone_idx = pgdat->nr_zones - 1;
-		}
+					balanced_order == new_order)
+			kswapd_read_request(pgdat, &req_seq, &new_order,
+					    &new_classzone_idx);
 
 		if (order < new_order || classzone_idx > new_classzone_idx) {
 			/*
@@ -3137,23 +3362,17 @@ static int kswapd(void *p)
 			classzone_idx = new_classzone_idx;
 		} else {
 			kswapd_try_to_sleep(pgdat, balanced_order,
-						balanced_classzone_idx);
-			order = pgdat->kswapd_max_order;
-			classzone_idx = pgdat->classzone_idx;
+						balanced_classzone_idx, req_seq);
+			kswapd_read_request(pgdat, &req_seq, &order,
+					    &classzone_idx);
 			new_order = order;
 			new_classzone_idx = classzone_idx;
-			pgdat->kswapd_max_order = 0;
-			pgdat->classzone_idx = pgdat->nr_zones - 1;
 		}
 
 		ret = try_to_freeze();
 		if (kthread_should_stop())
 			break;
 
-#ifdef CONFIG_RUNTIME_COMPCACHE
-		atomic_set(&kswapd_running, 1);
-#endif /* CONFIG_RUNTIME_COMPCACHE */
-
 		/*
 		 * We can speed up thawing tasks if we don't call balance_pgdat
 		 * after returning from the refrigerator
@@ -3165,15 +3384,19 @@ static int kswapd(void *p)
 						&balanced_classzone_idx);
 		}
 	}
+	kswapd_account_sleep(pgdat);
 	return 0;
 }
 
 /*
- * A zone is low on free memory, so wake its kswapd task to service it.
+ * A zone is low on free memory, so wake its kswapd tasks to service it.
+ * All kswapd threads of the node sleep on kswapd_wait non-exclusively,
+ * so a single wakeup gets every one of them scanning.
  */
 void wakeup_kswapd(struct zone *zone, int order, enum zone_type classzone_idx)
 {
 	pg_data_t *pgdat;
+	unsigned long flags;
 
 	if (!populated_zone(zone))
 		return;
@@ -3181,10 +3404,14 @@ void wakeup_kswapd(struct zone *zone, int order, enum zone_type classzone_idx)
 	if (!cpuset_zone_allowed_hardwall(zone, GFP_KERNEL))
 		return;
 	pgdat = zone->zone_pgdat;
+	spin_lock_irqsave(&pgdat->kswapd_req_lock, flags);
 	if (pgdat->kswapd_max_order < order) {
 		pgdat->kswapd_max_order = order;
 		pgdat->classzone_idx = min(pgdat->classzone_idx, classzone_idx);
+		pgdat->kswapd_req_seq++;
+		pgdat->kswapd_req_readers = 0;
 	}
+	spin_unlock_irqrestore(&pgdat->kswapd_req_lock, flags);
 	if (!waitqueue_active(&pgdat->kswapd_wait))
 		return;
 	if (zone_watermark_ok_safe(zone, order, low_wmark_pages(zone), 0, 0))
@@ -3252,17 +3479,80 @@ static int __devinit cpu_callback(struct notifier_block *nfb,
 		for_each_node_state(nid, N_HIGH_MEMORY) {
 			pg_data_t *pgdat = NODE_DATA(nid);
 			const struct cpumask *mask;
+			int i;
 
 			mask = cpumask_of_node(pgdat->node_id);
 
-			if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
-				/* One of our CPUs online: restore mask */
-				set_cpus_allowed_ptr(pgdat->kswapd, mask);
+			if (cpumask_any_and(cpu_online_mask, mask) >= nr_cpu_ids)
+				continue;
+
+			/* One of our CPUs online: restore mask */
+			for (i = 0; i < MAX_KSWAPD_THREADS; i++)
+				if (pgdat->kswapd[i])
+					set_cpus_allowed_ptr(pgdat->kswapd[i],
+							     mask);
 		}
 	}
 	return NOTIFY_OK;
 }
 
+/*
+ * Number of kswapd threads per node.  Background reclaim of a node is
+ * shared by all of them: they are woken together and each runs
+ * balance_pgdat() on the same LRU lists, isolating disjoint
+ * SWAP_CLUSTER_MAX batches under the lru_lock, until the watermark
+ * checks in balance_pgdat() find the node balanced again.  This lets
+ * reclaim work that is CPU bound, such as compressing pages into zram,
+ * spread over several CPUs instead of pushing allocators into direct
+ * reclaim.
+ */
+int kswapd_threads = 1;
+static DEFINE_MUTEX(kswapd_threads_lock);
+
+/* Keep the number of threads that must read each kswapd request */
+static void kswapd_set_nr_threads(pg_data_t *pgdat, int delta)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pgdat->kswapd_req_lock, flags);
+	pgdat->kswapd_nr_threads += delta;
+	spin_unlock_irqrestore(&pgdat->kswapd_req_lock, flags);
+}
+
+static int kswapd_run_thread(pg_data_t *pgdat, int tid)
+{
+	struct task_struct *tsk;
+
+	if (pgdat->kswapd[tid])
+		return 0;
+
+	/* Counted before it runs, so it is waited for from its first read */
+	kswapd_set_nr_threads(pgdat, 1);
+	if (tid)
+		tsk = kthread_run(kswapd, pgdat, "kswapd%d:%d",
+				  pgdat->node_id, tid);
+	else
+		tsk = kthread_run(kswapd, pgdat, "kswapd%d", pgdat->node_id);
+	if (IS_ERR(tsk)) {
+		kswapd_set_nr_threads(pgdat, -1);
+		return PTR_ERR(tsk);
+	}
+
+	pgdat->kswapd[tid] = tsk;
+	return 0;
+}
+
+static void kswapd_stop_thread(pg_data_t *pgdat, int tid)
+{
+	struct task_struct *tsk = pgdat->kswapd[tid];
+
+	if (tsk) {
+		kthread_stop(tsk);
+		pgdat->kswapd[tid] = NULL;
+		kswapd_set_nr_threads(pgdat, -1);
+	}
+}
+
 /*
  * This kswapd start function will be called by init and node-hot-add.
  * On node-hot-add, kswapd will moved to proper cpus if cpus are hot-added.
@@ -3271,17 +3561,20 @@ int kswapd_run(int nid)
 {
 	pg_data_t *pgdat = NODE_DATA(nid);
 	int ret = 0;
+	int i;
 
-	if (pgdat->kswapd)
-		return 0;
-
-	pgdat->kswapd = kthread_run(kswapd, pgdat, "kswapd%d", nid);
-	if (IS_ERR(pgdat->kswapd)) {
-		/* failure at boot is fatal */
-		BUG_ON(system_state == SYSTEM_BOOTING);
-		printk("Failed to start kswapd on node %d\n",nid);
-		ret = -1;
+	mutex_lock(&kswapd_threads_lock);
+	for (i = 0; i < kswapd_threads; i++) {
+		ret = kswapd_run_thread(pgdat, i);
+		if (ret) {
+			/* failure at boot is fatal */
+			BUG_ON(system_state == SYSTEM_BOOTING);
+			printk("Failed to start kswapd on node %d\n", nid);
+			ret = -1;
+			break;
+		}
 	}
+	mutex_unlock(&kswapd_threads_lock);
 	return ret;
 }
 
@@ -3290,10 +3583,47 @@ int kswapd_run(int nid)
  */
 void kswapd_stop(int nid)
 {
-	struct task_struct *kswapd = NODE_DATA(nid)->kswapd;
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int i;
 
-	if (kswapd)
-		kthread_stop(kswapd);
+	mutex_lock(&kswapd_threads_lock);
+	for (i = 0; i < MAX_KSWAPD_THREADS; i++)
+		kswapd_stop_thread(pgdat, i);
+	mutex_unlock(&kswapd_threads_lock);
+}
+
+/*
+ * kswapd_threads_sysctl_handler - just a wrapper around proc_dointvec_minmax
+ * so that the set of running kswapd threads follows vm.kswapd_threads.
+ */
+int kswapd_threads_sysctl_handler(struct ctl_table *table, int write,
+	void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int nid, i;
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	mutex_lock(&kswapd_threads_lock);
+	for_each_node_state(nid, N_HIGH_MEMORY) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		for (i = MAX_KSWAPD_THREADS - 1; i >= kswapd_threads; i--)
+			kswapd_stop_thread(pgdat, i);
+		for (i = 0; i < kswapd_threads; i++) {
+			ret = kswapd_run_thread(pgdat, i);
+			if (ret) {
+				pr_warn("Failed to start kswapd thread %d on node %d\n",
+					i, nid);
+				break;
+			}
+		}
+	}
+	mutex_unlock(&kswapd_threads_lock);
+
+	return ret;
 }
 
 static int __init kswapd_init(void)
@@ -3413,6 +3743,9 @@ static int __zone_reclaim(struct zone *zone, gfp_t gfp_mask, unsigned int order)
 	};
 	unsigned long nr_slab_pages0, nr_slab_pages1;
 
+	nodes_clear(shrink.nodes_to_scan);
+	node_set(zone_to_nid(zone), shrink.nodes_to_scan);
+
 	cond_resched();
 	/*
 	 * We need to be able to allocate from the reserves for RECLAIM_SWAP
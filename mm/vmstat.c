@@ -715,6 +715,9 @@ const char * const vmstat_text[] = {
 	"nr_shmem",
 	"nr_dirtied",
 	"nr_written",
+	"workingset_refault",
+	"workingset_activate",
+	"workingset_nodereclaim",
 
 #ifdef CONFIG_NUMA
 	"numa_hit",
@@ -750,6 +753,12 @@ const char * const vmstat_text[] = {
 
 	"pgfault",
 	"pgmajfault",
+	"faultaround_mapped",
+	"faultaround_hit",
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	"speculative_pgfault",
+	"speculative_pgfault_fallback",
+#endif
 
 	TEXTS_FOR_ZONES("pgrefill")
 	TEXTS_FOR_ZONES("pgsteal_kswapd")
@@ -768,6 +777,7 @@ const char * const vmstat_text[] = {
 	"kswapd_skip_congestion_wait",
 	"pageoutrun",
 	"allocstall",
+	"allocstall_us",
 
 	"pgrotated",
 
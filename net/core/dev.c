@@ -135,6 +135,7 @@
 #include <linux/net_tstamp.h>
 #include <linux/static_key.h>
 #include <net/flow_keys.h>
+#include <net/busy_poll.h>
 
 #include "net-sysfs.h"
 
@@ -2091,25 +2092,6 @@ static int dev_gso_segment(struct sk_buff *skb, netdev_features_t features)
 	return 0;
 }
 
-/*
- * Try to orphan skb early, right before transmission by the device.
- * We cannot orphan skb if tx timestamp is requested or the sk-reference
- * is needed on driver level for other reasons, e.g. see net/can/raw.c
- */
-static inline void skb_orphan_try(struct sk_buff *skb)
-{
-	struct sock *sk = skb->sk;
-
-	if (sk && !skb_shinfo(skb)->tx_flags) {
-		/* skb_tx_hash() wont be able to get sk.
-		 * We copy sk_hash into skb->rxhash
-		 */
-		if (!skb->rxhash)
-			skb->rxhash = sk->sk_hash;
-		skb_orphan(skb);
-	}
-}
-
 static bool can_checksum_protocol(netdev_features_t features, __be16 protocol)
 {
 	return ((features & NETIF_F_GEN_CSUM) ||
@@ -2195,8 +2177,6 @@ int dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
 		if (!list_empty(&ptype_all))
 			dev_queue_xmit_nit(skb, dev);
 
-		skb_orphan_try(skb);
-
 		features = netif_skb_features(skb);
 
 		if (vlan_tx_tag_present(skb) &&
@@ -3545,6 +3525,7 @@ EXPORT_SYMBOL(skb_gro_reset_offset);
 
 gro_result_t napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 {
+	skb_mark_napi_id(skb, napi);
 	skb_gro_reset_offset(skb);
 
 	return napi_skb_finish(__napi_gro_receive(napi, skb), skb);
@@ -3647,6 +3628,7 @@ gro_result_t napi_gro_frags(struct napi_struct *napi)
 	if (!skb)
 		return GRO_DROP;
 
+	skb_mark_napi_id(skb, napi);
 	return napi_frags_finish(napi, skb, __napi_gro_receive(napi, skb));
 }
 EXPORT_SYMBOL(napi_gro_frags);
@@ -3781,6 +3763,155 @@ void napi_complete(struct napi_struct *n)
 }
 EXPORT_SYMBOL(napi_complete);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+unsigned int sysctl_net_busy_read __read_mostly;
+
+#define NAPI_HASH_BITS	8
+
+static DEFINE_SPINLOCK(napi_hash_lock);
+static unsigned int napi_gen_id;
+/* number of sk_busy_loop() callers between their napi lookup and exit */
+static atomic_t napi_busy_pollers = ATOMIC_INIT(0);
+static struct hlist_head napi_hash[1 << NAPI_HASH_BITS];
+
+/* must be called under rcu_read_lock(), as we dont take a reference */
+static struct napi_struct *napi_by_id(unsigned int napi_id)
+{
+	unsigned int hash = napi_id % ARRAY_SIZE(napi_hash);
+	struct hlist_node *node;
+	struct napi_struct *napi;
+
+	hlist_for_each_entry_rcu(napi, node, &napi_hash[hash], napi_hash_node)
+		if (napi->napi_id == napi_id)
+			return napi;
+
+	return NULL;
+}
+
+static void napi_hash_add(struct napi_struct *napi)
+{
+	spin_lock(&napi_hash_lock);
+
+	/* 0 is not a valid id, we also skip an id that is taken
+	 * we expect both events to be extremely rare
+	 */
+	do {
+		if (unlikely(++napi_gen_id < MIN_NAPI_ID))
+			napi_gen_id = MIN_NAPI_ID;
+	} while (napi_by_id(napi_gen_id));
+	napi->napi_id = napi_gen_id;
+
+	hlist_add_head_rcu(&napi->napi_hash_node,
+			   &napi_hash[napi->napi_id % ARRAY_SIZE(napi_hash)]);
+
+	spin_unlock(&napi_hash_lock);
+}
+
+/* Busy pollers look @napi up under rcu_read_lock(), so the caller must
+ * let them finish, see napi_hash_sync(), before freeing the memory
+ * containing it.
+ */
+static void napi_hash_del(struct napi_struct *napi)
+{
+	spin_lock(&napi_hash_lock);
+	hlist_del_rcu(&napi->napi_hash_node);
+	spin_unlock(&napi_hash_lock);
+}
+
+/* Wait for busy pollers that may still see NAPIs removed from the hash.
+ * Pairs with the barrier after the increment in sk_busy_loop(): a poller
+ * that was not counted yet will not find the removed entries.
+ */
+static void napi_hash_sync(void)
+{
+	smp_mb();
+	if (atomic_read(&napi_busy_pollers))
+		synchronize_net();
+}
+
+/**
+ * sk_busy_loop - spin on the NAPI context that feeds a socket
+ * @sk: socket with a non zero sk_ll_usec and a recorded sk_napi_id
+ * @nonblock: poll only once instead of until sk_ll_usec expires
+ *
+ * Runs the NAPI poll routine of the device queue that last delivered
+ * a packet to @sk, in process context, until data shows up in the
+ * socket receive queue, the time budget is exhausted or the task
+ * needs to reschedule. Returns true if the receive queue is not empty.
+ */
+bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	unsigned long end_time = !nonblock ? sk_busy_loop_end_time(sk) : 0;
+	struct napi_struct *napi;
+	bool rc = false;
+
+	atomic_inc(&napi_busy_pollers);
+	smp_mb__after_atomic_inc();
+	rcu_read_lock();
+
+	napi = napi_by_id(sk->sk_napi_id);
+	if (!napi)
+		goto out;
+
+	do {
+		int work = 0;
+
+		local_bh_disable();
+		if (napi_schedule_prep(napi)) {
+			void *have = netpoll_poll_lock(napi);
+			LIST_HEAD(busy_list);
+
+			/* We own NAPI_STATE_SCHED now. Park the context on a
+			 * private list so that the driver's napi_complete()
+			 * can unlink it exactly as it would from the per-cpu
+			 * poll_list in net_rx_action().
+			 */
+			list_add(&napi->poll_list, &busy_list);
+			work = napi->poll(napi, BUSY_POLL_BUDGET);
+			if (work == BUSY_POLL_BUDGET) {
+				/* more work pending: hand the context over
+				 * to net_rx_action(), unless it is being
+				 * disabled.
+				 */
+				if (unlikely(napi_disable_pending(napi))) {
+					napi_complete(napi);
+				} else {
+					list_del(&napi->poll_list);
+					__napi_schedule(napi);
+				}
+			}
+			netpoll_poll_unlock(have);
+		}
+		if (work > 0)
+			NET_ADD_STATS_BH(sock_net(sk),
+					 LINUX_MIB_BUSYPOLLRXPACKETS, work);
+		local_bh_enable();
+
+		cpu_relax();
+	} while (!nonblock && skb_queue_empty(&sk->sk_receive_queue) &&
+		 !need_resched() && !busy_loop_timeout(end_time));
+
+	rc = !skb_queue_empty(&sk->sk_receive_queue);
+out:
+	rcu_read_unlock();
+	atomic_dec(&napi_busy_pollers);
+	return rc;
+}
+EXPORT_SYMBOL(sk_busy_loop);
+#else
+static inline void napi_hash_add(struct napi_struct *napi)
+{
+}
+
+static inline void napi_hash_del(struct napi_struct *napi)
+{
+}
+
+static inline void napi_hash_sync(void)
+{
+}
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 		    int (*poll)(struct napi_struct *, int), int weight)
 {
@@ -3797,16 +3928,19 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 	napi->poll_owner = -1;
 #endif
 	set_bit(NAPI_STATE_SCHED, &napi->state);
+	napi_hash_add(napi);
 }
 EXPORT_SYMBOL(netif_napi_add);
 
-void netif_napi_del(struct napi_struct *napi)
+static void __netif_napi_del(struct napi_struct *napi)
 {
 	struct sk_buff *skb, *next;
 
 	list_del_init(&napi->dev_list);
 	napi_free_frags(napi);
 
+	napi_hash_del(napi);
+
 	for (skb = napi->gro_list; skb; skb = next) {
 		next = skb->next;
 		skb->next = NULL;
@@ -3816,6 +3950,12 @@ void netif_napi_del(struct napi_struct *napi)
 	napi->gro_list = NULL;
 	napi->gro_count = 0;
 }
+
+void netif_napi_del(struct napi_struct *napi)
+{
+	__netif_napi_del(napi);
+	napi_hash_sync();
+}
 EXPORT_SYMBOL(netif_napi_del);
 
 static void net_rx_action(struct softirq_action *h)
@@ -6030,8 +6170,10 @@ void free_netdev(struct net_device *dev)
 	/* Flush device addresses */
 	dev_addr_flush(dev);
 
+	/* One wait for busy pollers per device, not per queue */
 	list_for_each_entry_safe(p, n, &dev->napi_list, dev_list)
-		netif_napi_del(p);
+		__netif_napi_del(p);
+	napi_hash_sync();
 
 	free_percpu(dev->pcpu_refcnt);
 	dev->pcpu_refcnt = NULL;
@@ -15,11 +15,13 @@
 #define DEBUG
 
 #include <linux/file.h>
+#include <linux/hash.h>
 #include <linux/inetdevice.h>
 #include <linux/module.h>
 #include <linux/netfilter/x_tables.h>
 #include <linux/netfilter/xt_qtaguid.h>
 #include <linux/ratelimit.h>
+#include <linux/rculist.h>
 #include <linux/skbuff.h>
 #include <linux/workqueue.h>
 #include <net/addrconf.h>
@@ -133,6 +135,12 @@ static struct proc_dir_entry *iface_stat_fmt_procfile;
  * Notice how sock_tag_list_lock is held sometimes when uid_tag_data_tree_lock
  * is acquired.
  *
+ * The per packet path (qtaguid_mt()) takes none of the above for entries that
+ * already exist: iface_stat_list, sock_tag_hash, tag_counter_set_hash and
+ * iface_stat->tag_stat_hash are walked under rcu_read_lock(), and the
+ * counters are per-cpu. Whoever unlinks an entry from one of those frees it
+ * after a grace period.
+ *
  * Call tree with all lock holders as of 2012-04-27:
  *
  * iface_stat_fmt_proc_read()
@@ -188,14 +196,14 @@ static struct proc_dir_entry *iface_stat_fmt_procfile;
  *   account_for_uid()
  *     if_tag_stat_update()
  *       get_sock_stat()
- *         sock_tag_list_lock
- *       struct iface_stat->tag_stat_list_lock
- *         tag_stat_update()
- *           get_active_counter_set()
- *             tag_counter_set_list_lock
+ *         (rcu: sock_tag_hash)
+ *       tag_stat_update()
+ *         get_active_counter_set()
+ *           (rcu: tag_counter_set_hash)
+ *       struct iface_stat->tag_stat_list_lock (only to create a tag_stat)
  *         tag_stat_update()
  *           get_active_counter_set()
- *             tag_counter_set_list_lock
+ *             (rcu: tag_counter_set_hash)
  *
  *
  * qtaguid_ctrl_parse()
@@ -224,9 +232,11 @@ static LIST_HEAD(iface_stat_list);
 static DEFINE_SPINLOCK(iface_stat_list_lock);
 
 static struct rb_root sock_tag_tree = RB_ROOT;
+static struct hlist_head sock_tag_hash[1 << SOCK_TAG_HASH_BITS];
 static DEFINE_SPINLOCK(sock_tag_list_lock);
 
 static struct rb_root tag_counter_set_tree = RB_ROOT;
+static struct hlist_head tag_counter_set_hash[1 << TAG_COUNTER_SET_HASH_BITS];
 static DEFINE_SPINLOCK(tag_counter_set_list_lock);
 
 static struct rb_root uid_tag_data_tree = RB_ROOT;
@@ -269,6 +279,29 @@ static inline void dc_add_byte_packets(struct data_counters *counters, int set,
 	counters->bpc[set][direction][ifs_proto].packets += packets;
 }
 
+static struct data_counters_pcpu *dc_pcpu_alloc(void)
+{
+	/* No alloc_percpu(): tag_stats get created from the packet path. */
+	return kcalloc(nr_cpu_ids, sizeof(struct data_counters_pcpu),
+		       GFP_ATOMIC);
+}
+
+/* Caller must have BH disabled, as the xt table walk does. */
+static inline void dc_pcpu_add_byte_packets(struct data_counters_pcpu *pcpu,
+					    int set,
+					    enum ifs_tx_rx direction,
+					    enum ifs_proto ifs_proto,
+					    int bytes,
+					    int packets)
+{
+	struct data_counters_pcpu *slot = &pcpu[smp_processor_id()];
+
+	u64_stats_update_begin(&slot->syncp);
+	dc_add_byte_packets(&slot->counters, set, direction, ifs_proto,
+			    bytes, packets);
+	u64_stats_update_end(&slot->syncp);
+}
+
 static struct tag_node *tag_node_tree_search(struct rb_root *root, tag_t tag)
 {
 	struct rb_node *node = root->rb_node;
@@ -417,10 +450,97 @@ static void sock_tag_tree_erase(struct rb_root *st_to_free_tree)
 			 get_uid_from_tag(st_entry->tag));
 		rb_erase(&st_entry->sock_node, st_to_free_tree);
 		sockfd_put(st_entry->socket);
-		kfree(st_entry);
+		kfree_rcu(st_entry, rcu);
 	}
 }
 
+/*
+ * sock_tag_hash mirrors sock_tag_tree for the packet path.
+ * Caller must hold sock_tag_list_lock to add/del.
+ */
+static void sock_tag_hash_add(struct sock_tag *st_entry)
+{
+	hlist_add_head_rcu(&st_entry->sock_hnode,
+			   &sock_tag_hash[hash_ptr(st_entry->sk,
+						   SOCK_TAG_HASH_BITS)]);
+}
+
+static void sock_tag_hash_del(struct sock_tag *st_entry)
+{
+	hlist_del_rcu(&st_entry->sock_hnode);
+}
+
+/* Caller must be in an rcu read side section. */
+static struct sock_tag *sock_tag_hash_search(const struct sock *sk)
+{
+	struct sock_tag *st_entry;
+	struct hlist_node *pos;
+	struct hlist_head *head;
+
+	head = &sock_tag_hash[hash_ptr(sk, SOCK_TAG_HASH_BITS)];
+	hlist_for_each_entry_rcu(st_entry, pos, head, sock_hnode) {
+		if (st_entry->sk == sk)
+			return st_entry;
+	}
+	return NULL;
+}
+
+/* Caller must hold tag_counter_set_list_lock */
+static void tag_counter_set_hash_add(struct tag_counter_set *tcs)
+{
+	hlist_add_head_rcu(&tcs->hnode,
+			   &tag_counter_set_hash[hash_64(tcs->tn.tag,
+						TAG_COUNTER_SET_HASH_BITS)]);
+}
+
+/* Caller must be in an rcu read side section. */
+static struct tag_counter_set *tag_counter_set_hash_search(tag_t tag)
+{
+	struct tag_counter_set *tcs;
+	struct hlist_node *pos;
+	struct hlist_head *head;
+
+	head = &tag_counter_set_hash[hash_64(tag, TAG_COUNTER_SET_HASH_BITS)];
+	hlist_for_each_entry_rcu(tcs, pos, head, hnode) {
+		if (tcs->tn.tag == tag)
+			return tcs;
+	}
+	return NULL;
+}
+
+/* Caller must hold iface_entry->tag_stat_list_lock */
+static void tag_stat_hash_add(struct tag_stat *ts_entry,
+			      struct iface_stat *iface_entry)
+{
+	hlist_add_head_rcu(&ts_entry->hnode,
+			   &iface_entry->tag_stat_hash[hash_64(ts_entry->tn.tag,
+							TAG_STAT_HASH_BITS)]);
+}
+
+/* Caller must be in an rcu read side section. */
+static struct tag_stat *tag_stat_hash_search(struct iface_stat *iface_entry,
+					     tag_t tag)
+{
+	struct tag_stat *ts_entry;
+	struct hlist_node *pos;
+	struct hlist_head *head;
+
+	head = &iface_entry->tag_stat_hash[hash_64(tag, TAG_STAT_HASH_BITS)];
+	hlist_for_each_entry_rcu(ts_entry, pos, head, hnode) {
+		if (ts_entry->tn.tag == tag)
+			return ts_entry;
+	}
+	return NULL;
+}
+
+static void tag_stat_free_rcu(struct rcu_head *head)
+{
+	struct tag_stat *ts_entry = container_of(head, struct tag_stat, rcu);
+
+	kfree(ts_entry->counters);
+	kfree(ts_entry);
+}
+
 static struct proc_qtu_data *proc_qtu_data_tree_search(struct rb_root *root,
 						       const pid_t pid)
 {
@@ -738,17 +858,18 @@ static int get_active_counter_set(tag_t tag)
 		 tag, get_uid_from_tag(tag));
 	/* For now we only handle UID tags for active sets */
 	tag = get_utag_from_tag(tag);
-	spin_lock_bh(&tag_counter_set_list_lock);
-	tcs = tag_counter_set_tree_search(&tag_counter_set_tree, tag);
+	rcu_read_lock();
+	tcs = tag_counter_set_hash_search(tag);
 	if (tcs)
-		active_set = tcs->active_set;
-	spin_unlock_bh(&tag_counter_set_list_lock);
+		active_set = ACCESS_ONCE(tcs->active_set);
+	rcu_read_unlock();
 	return active_set;
 }
 
 /*
  * Find the entry for tracking the specified interface.
- * Caller must hold iface_stat_list_lock
+ * Caller must hold iface_stat_list_lock, or be in an rcu read side section
+ * (entries are never removed from the list).
  */
 static struct iface_stat *get_iface_entry(const char *ifname)
 {
@@ -761,7 +882,7 @@ static struct iface_stat *get_iface_entry(const char *ifname)
 	}
 
 	/* Iterate over interfaces */
-	list_for_each_entry(iface_entry, &iface_stat_list, list) {
+	list_for_each_entry_rcu(iface_entry, &iface_stat_list, list) {
 		if (!strcmp(ifname, iface_entry->ifname))
 			goto done;
 	}
@@ -788,9 +909,9 @@ static int pp_iface_stat_line(bool header, char *outp,
 			       "tx_other_bytes tx_other_packets\n"
 			);
 	} else {
-		struct data_counters *cnts;
+		struct data_counters counters, *cnts = &counters;
 		int cnt_set = 0;   /* We only use one set for the device */
-		cnts = &iface_entry->totals_via_skb;
+		dc_pcpu_fold(cnts, iface_entry->totals_via_skb);
 		len = snprintf(
 			outp, char_count,
 			"%s "
@@ -991,6 +1112,14 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 		kfree(new_iface);
 		return NULL;
 	}
+	new_iface->totals_via_skb = dc_pcpu_alloc();
+	if (new_iface->totals_via_skb == NULL) {
+		pr_err("qtaguid: iface_stat: create(%s): "
+		       "counters alloc failed\n", net_dev->name);
+		kfree(new_iface->ifname);
+		kfree(new_iface);
+		return NULL;
+	}
 	spin_lock_init(&new_iface->tag_stat_list_lock);
 	new_iface->tag_stat_tree = RB_ROOT;
 	_iface_stat_set_active(new_iface, net_dev, true);
@@ -1004,6 +1133,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 		pr_err("qtaguid: iface_stat: create(%s): "
 		       "work alloc failed\n", new_iface->ifname);
 		_iface_stat_set_active(new_iface, net_dev, false);
+		kfree(new_iface->totals_via_skb);
 		kfree(new_iface->ifname);
 		kfree(new_iface);
 		return NULL;
@@ -1011,7 +1141,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 	isw->iface_entry = new_iface;
 	INIT_WORK(&isw->iface_work, iface_create_proc_worker);
 	schedule_work(&isw->iface_work);
-	list_add(&new_iface->list, &iface_stat_list);
+	list_add_rcu(&new_iface->list, &iface_stat_list);
 	return new_iface;
 }
 
@@ -1192,16 +1322,13 @@ static struct sock_tag *get_sock_stat_nl(const struct sock *sk)
 	return sock_tag_tree_search(&sock_tag_tree, sk);
 }
 
+/* Caller must be in an rcu read side section. */
 static struct sock_tag *get_sock_stat(const struct sock *sk)
 {
-	struct sock_tag *sock_tag_entry;
 	MT_DEBUG("qtaguid: get_sock_stat(sk=%p)\n", sk);
 	if (!sk)
 		return NULL;
-	spin_lock_bh(&sock_tag_list_lock);
-	sock_tag_entry = get_sock_stat_nl(sk);
-	spin_unlock_bh(&sock_tag_list_lock);
-	return sock_tag_entry;
+	return sock_tag_hash_search(sk);
 }
 
 static int ipx_proto(const struct sk_buff *skb,
@@ -1226,20 +1353,22 @@ static int ipx_proto(const struct sk_buff *skb,
 }
 
 static void
-data_counters_update(struct data_counters *dc, int set,
+data_counters_update(struct data_counters_pcpu *dc, int set,
 		     enum ifs_tx_rx direction, int proto, int bytes)
 {
 	switch (proto) {
 	case IPPROTO_TCP:
-		dc_add_byte_packets(dc, set, direction, IFS_TCP, bytes, 1);
+		dc_pcpu_add_byte_packets(dc, set, direction, IFS_TCP, bytes,
+					 1);
 		break;
 	case IPPROTO_UDP:
-		dc_add_byte_packets(dc, set, direction, IFS_UDP, bytes, 1);
+		dc_pcpu_add_byte_packets(dc, set, direction, IFS_UDP, bytes,
+					 1);
 		break;
 	case IPPROTO_IP:
 	default:
-		dc_add_byte_packets(dc, set, direction, IFS_PROTO_OTHER, bytes,
-				    1);
+		dc_pcpu_add_byte_packets(dc, set, direction, IFS_PROTO_OTHER,
+					 bytes, 1);
 		break;
 	}
 }
@@ -1352,21 +1481,21 @@ static void iface_stat_update_from_skb(const struct sk_buff *skb,
 		 par->hooknum, __func__, el_dev->name, el_dev->type,
 		 par->family, proto, direction);
 
-	spin_lock_bh(&iface_stat_list_lock);
+	rcu_read_lock();
 	entry = get_iface_entry(el_dev->name);
 	if (entry == NULL) {
 		IF_DEBUG("qtaguid[%d]: iface_stat: %s(%s): not tracked\n",
 			 par->hooknum, __func__, el_dev->name);
-		spin_unlock_bh(&iface_stat_list_lock);
+		rcu_read_unlock();
 		return;
 	}
 
 	IF_DEBUG("qtaguid[%d]: %s(%s): entry=%p\n", par->hooknum,  __func__,
 		 el_dev->name, entry);
 
-	data_counters_update(&entry->totals_via_skb, 0, direction, proto,
+	data_counters_update(entry->totals_via_skb, 0, direction, proto,
 			     bytes);
-	spin_unlock_bh(&iface_stat_list_lock);
+	rcu_read_unlock();
 }
 
 static void tag_stat_update(struct tag_stat *tag_entry,
@@ -1378,7 +1507,7 @@ static void tag_stat_update(struct tag_stat *tag_entry,
 		 "dir=%d proto=%d bytes=%d)\n",
 		 tag_entry->tn.tag, get_uid_from_tag(tag_entry->tn.tag),
 		 active_set, direction, proto, bytes);
-	data_counters_update(&tag_entry->counters, active_set, direction,
+	data_counters_update(tag_entry->counters, active_set, direction,
 			     proto, bytes);
 	if (tag_entry->parent_counters)
 		data_counters_update(tag_entry->parent_counters, active_set,
@@ -1387,11 +1516,13 @@ static void tag_stat_update(struct tag_stat *tag_entry,
 
 /*
  * Create a new entry for tracking the specified {acct_tag,uid_tag} within
- * the interface.
+ * the interface. parent_counters must be set before the entry becomes
+ * visible to lockless lookups, so it is passed in here.
  * iface_entry->tag_stat_list_lock should be held.
  */
 static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
-					   tag_t tag)
+					   tag_t tag,
+					   struct data_counters_pcpu *parent)
 {
 	struct tag_stat *new_tag_stat_entry = NULL;
 	IF_DEBUG("qtaguid: iface_stat: %s(): ife=%p tag=0x%llx"
@@ -1402,8 +1533,17 @@ static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
 		pr_err("qtaguid: iface_stat: tag stat alloc failed\n");
 		goto done;
 	}
+	new_tag_stat_entry->counters = dc_pcpu_alloc();
+	if (!new_tag_stat_entry->counters) {
+		pr_err("qtaguid: iface_stat: tag stat counters alloc failed\n");
+		kfree(new_tag_stat_entry);
+		new_tag_stat_entry = NULL;
+		goto done;
+	}
 	new_tag_stat_entry->tn.tag = tag;
+	new_tag_stat_entry->parent_counters = parent;
 	tag_stat_tree_insert(new_tag_stat_entry, &iface_entry->tag_stat_tree);
+	tag_stat_hash_add(new_tag_stat_entry, iface_entry);
 done:
 	return new_tag_stat_entry;
 }
@@ -1415,7 +1555,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	struct tag_stat *tag_stat_entry;
 	tag_t tag, acct_tag;
 	tag_t uid_tag;
-	struct data_counters *uid_tag_counters;
+	struct data_counters_pcpu *uid_tag_counters;
 	struct sock_tag *sock_tag_entry;
 	struct iface_stat *iface_entry;
 	struct tag_stat *new_tag_stat = NULL;
@@ -1423,12 +1563,12 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		"uid=%u sk=%p dir=%d proto=%d bytes=%d)\n",
 		 ifname, uid, sk, direction, proto, bytes);
 
-
+	rcu_read_lock();
 	iface_entry = get_iface_entry(ifname);
 	if (!iface_entry) {
 		pr_err_ratelimited("qtaguid: tag_stat: stat_update() "
 				   "%s not found\n", ifname);
-		return;
+		goto out;
 	}
 	/* It is ok to process data when an iface_entry is inactive */
 
@@ -1441,7 +1581,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	 */
 	sock_tag_entry = get_sock_stat(sk);
 	if (sock_tag_entry) {
-		tag = sock_tag_entry->tag;
+		tag = sock_tag_read(sock_tag_entry);
 		acct_tag = get_atag_from_tag(tag);
 		uid_tag = get_utag_from_tag(tag);
 	} else {
@@ -1452,19 +1592,26 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	MT_DEBUG("qtaguid: tag_stat: stat_update(): "
 		 " looking for tag=0x%llx (uid=%u) in ife=%p\n",
 		 tag, get_uid_from_tag(tag), iface_entry);
+
+	/*
+	 * Common case: the {acct_tag, uid_tag} entry already exists.
+	 * Updating it handles both stats: {0, uid_tag} will also get updated.
+	 */
+	tag_stat_entry = tag_stat_hash_search(iface_entry, tag);
+	if (tag_stat_entry) {
+		tag_stat_update(tag_stat_entry, direction, proto, bytes);
+		goto out;
+	}
+
 	/* Loop over tag list under this interface for {acct_tag,uid_tag} */
 	spin_lock_bh(&iface_entry->tag_stat_list_lock);
 
+	/* Recheck, somebody might have created it while we were unlocked */
 	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
 					      tag);
 	if (tag_stat_entry) {
-		/*
-		 * Updating the {acct_tag, uid_tag} entry handles both stats:
-		 * {0, uid_tag} will also get updated.
-		 */
 		tag_stat_update(tag_stat_entry, direction, proto, bytes);
-		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
-		return;
+		goto unlock;
 	}
 
 	/* Loop over tag list under this interface for {0,uid_tag} */
@@ -1476,20 +1623,20 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		 * No parent counters. So
 		 *  - No {0, uid_tag} stats and no {acc_tag, uid_tag} stats.
 		 */
-		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag);
+		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag, NULL);
 		if (!new_tag_stat)
 			goto unlock;
-		uid_tag_counters = &new_tag_stat->counters;
+		uid_tag_counters = new_tag_stat->counters;
 	} else {
-		uid_tag_counters = &tag_stat_entry->counters;
+		uid_tag_counters = tag_stat_entry->counters;
 	}
 
 	if (acct_tag) {
 		/* Create the child {acct_tag, uid_tag} and hook up parent. */
-		new_tag_stat = create_if_tag_stat(iface_entry, tag);
+		new_tag_stat = create_if_tag_stat(iface_entry, tag,
+						  uid_tag_counters);
 		if (!new_tag_stat)
 			goto unlock;
-		new_tag_stat->parent_counters = uid_tag_counters;
 	} else {
 		/*
 		 * For new_tag_stat to be still NULL here would require:
@@ -1504,6 +1651,8 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	tag_stat_update(new_tag_stat, direction, proto, bytes);
 unlock:
 	spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+out:
+	rcu_read_unlock();
 }
 
 static int iface_netdev_event_handler(struct notifier_block *nb,
@@ -2101,6 +2250,7 @@ static int ctrl_cmd_delete(const char *input)
 
 		if (!acct_tag || st_entry->tag == tag) {
 			rb_erase(&st_entry->sock_node, &sock_tag_tree);
+			sock_tag_hash_del(st_entry);
 			/* Can't sockfd_put() within spinlock, do it later. */
 			sock_tag_tree_insert(st_entry, &st_to_free_tree);
 			tr_entry = lookup_tag_ref(st_entry->tag, NULL);
@@ -2133,7 +2283,8 @@ static int ctrl_cmd_delete(const char *input)
 			 get_uid_from_tag(tcs_entry->tn.tag),
 			 tcs_entry->active_set);
 		rb_erase(&tcs_entry->tn.node, &tag_counter_set_tree);
-		kfree(tcs_entry);
+		hlist_del_rcu(&tcs_entry->hnode);
+		kfree_rcu(tcs_entry, rcu);
 	}
 	spin_unlock_bh(&tag_counter_set_list_lock);
 
@@ -2164,7 +2315,8 @@ static int ctrl_cmd_delete(const char *input)
 					 entry_uid);
 				rb_erase(&ts_entry->tn.node,
 					 &iface_entry->tag_stat_tree);
-				kfree(ts_entry);
+				hlist_del_rcu(&ts_entry->hnode);
+				call_rcu(&ts_entry->rcu, tag_stat_free_rcu);
 			}
 		}
 		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
@@ -2247,6 +2399,7 @@ static int ctrl_cmd_counter_set(const char *input)
 		}
 		tcs->tn.tag = tag;
 		tag_counter_set_tree_insert(tcs, &tag_counter_set_tree);
+		tag_counter_set_hash_add(tcs);
 		CT_DEBUG("qtaguid: ctrl_counterset(%s): added tcs tag=0x%llx "
 			 "(uid=%u) set=%d\n",
 			 input, tag, get_uid_from_tag(tag), counter_set);
@@ -2348,7 +2501,9 @@ static int ctrl_cmd_tag(const char *input)
 		BUG_ON(IS_ERR_OR_NULL(prev_tag_ref_entry));
 		BUG_ON(prev_tag_ref_entry->num_sock_tags <= 0);
 		prev_tag_ref_entry->num_sock_tags--;
+		u64_stats_update_begin(&sock_tag_entry->tag_syncp);
 		sock_tag_entry->tag = full_tag;
+		u64_stats_update_end(&sock_tag_entry->tag_syncp);
 	} else {
 		CT_DEBUG("qtaguid: ctrl_tag(%s): newtag for sk=%p\n",
 			 input, el_socket->sk);
@@ -2388,6 +2543,7 @@ static int ctrl_cmd_tag(const char *input)
 		spin_unlock_bh(&uid_tag_data_tree_lock);
 
 		sock_tag_tree_insert(sock_tag_entry, &sock_tag_tree);
+		sock_tag_hash_add(sock_tag_entry);
 		atomic64_inc(&qtu_events.sockets_tagged);
 	}
 	spin_unlock_bh(&sock_tag_list_lock);
@@ -2454,6 +2610,7 @@ static int ctrl_cmd_untag(const char *input)
 	 * so it can do whatever it wants to it.
 	 */
 	rb_erase(&sock_tag_entry->sock_node, &sock_tag_tree);
+	sock_tag_hash_del(sock_tag_entry);
 
 	tag_ref_entry = lookup_tag_ref(sock_tag_entry->tag, &utd_entry);
 	BUG_ON(!tag_ref_entry);
@@ -2490,7 +2647,7 @@ static int ctrl_cmd_untag(const char *input)
 		 atomic_long_read(&el_socket->file->f_count) - 1);
 	sockfd_put(el_socket);
 
-	kfree(sock_tag_entry);
+	kfree_rcu(sock_tag_entry, rcu);
 	atomic64_inc(&qtu_events.sockets_untagged);
 
 	return 0;
@@ -2569,6 +2726,8 @@ struct proc_print_info {
 	char **num_items_returned;
 	struct iface_stat *iface_entry;
 	struct tag_stat *ts_entry;
+	/* ts_entry's per-cpu counters, folded once for all the sets */
+	struct data_counters ts_counters;
 	int item_index;
 	int items_to_skip;
 	int char_count;
@@ -2608,7 +2767,7 @@ static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 		}
 		if (ppi->item_index++ < ppi->items_to_skip)
 			return 0;
-		cnts = &ppi->ts_entry->counters;
+		cnts = &ppi->ts_counters;
 		len = snprintf(
 			ppi->outp, ppi->char_count,
 			"%d %s 0x%llx %u %u "
@@ -2649,6 +2808,8 @@ static bool pp_sets(struct proc_print_info *ppi)
 {
 	int len;
 	int counter_set;
+
+	dc_pcpu_fold(&ppi->ts_counters, ppi->ts_entry->counters);
 	for (counter_set = 0; counter_set < IFS_MAX_COUNTER_SETS;
 	     counter_set++) {
 		len = pp_stats_line(ppi, counter_set);
@@ -2856,6 +3017,7 @@ static int qtudev_release(struct inode *inode, struct file *file)
 		free_tag_ref_from_utd_entry(tr, utd_entry);
 
 		rb_erase(&st_entry->sock_node, &sock_tag_tree);
+		sock_tag_hash_del(st_entry);
 		list_del(&st_entry->list);
 		/* Can't sockfd_put() within spinlock, do it later. */
 		sock_tag_tree_insert(st_entry, &st_to_free_tree);
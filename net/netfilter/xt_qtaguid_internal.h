@@ -11,8 +11,14 @@
 #define __XT_QTAGUID_INTERNAL_H__
 
 #include <linux/types.h>
+#include <linux/cache.h>
+#include <linux/cpumask.h>
+#include <linux/list.h>
 #include <linux/rbtree.h>
+#include <linux/rcupdate.h>
 #include <linux/spinlock_types.h>
+#include <linux/string.h>
+#include <linux/u64_stats_sync.h>
 #include <linux/workqueue.h>
 
 /* Iface handling */
@@ -197,6 +203,50 @@ static inline uint64_t dc_sum_packets(struct data_counters *counters,
 		+ counters->bpc[set][direction][IFS_PROTO_OTHER].packets;
 }
 
+/*
+ * The packet path only ever bumps the slot belonging to the CPU it runs on
+ * (the xt tables are walked with BH disabled), so accounting a packet needs
+ * no lock. Readers fold all the slots via dc_pcpu_fold().
+ * One slot per possible cpu, see dc_pcpu_alloc().
+ */
+struct data_counters_pcpu {
+	struct data_counters counters;
+	struct u64_stats_sync syncp;
+} ____cacheline_aligned_in_smp;
+
+static inline void dc_pcpu_fold(struct data_counters *sum,
+				struct data_counters_pcpu *pcpu)
+{
+	struct data_counters snap;
+	unsigned int start;
+	int cpu, set, dir, proto;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		do {
+			start = u64_stats_fetch_begin(&pcpu[cpu].syncp);
+			snap = pcpu[cpu].counters;
+		} while (u64_stats_fetch_retry(&pcpu[cpu].syncp, start));
+
+		for (set = 0; set < IFS_MAX_COUNTER_SETS; set++)
+			for (dir = 0; dir < IFS_MAX_DIRECTIONS; dir++)
+				for (proto = 0; proto < IFS_MAX_PROTOS; proto++) {
+					sum->bpc[set][dir][proto].bytes +=
+						snap.bpc[set][dir][proto].bytes;
+					sum->bpc[set][dir][proto].packets +=
+						snap.bpc[set][dir][proto].packets;
+				}
+	}
+}
+
+/*
+ * The rb-trees below stay the authoritative index for the ctrl/stats side
+ * (ordered walks, deletes). The per-packet lookups go through RCU hashes
+ * maintained next to them by the same writers, under the same locks.
+ */
+#define SOCK_TAG_HASH_BITS 8
+#define TAG_COUNTER_SET_HASH_BITS 6
+#define TAG_STAT_HASH_BITS 6
 
 /* Generic X based nodes used as a base for rb_tree ops */
 struct tag_node {
@@ -206,12 +256,14 @@ struct tag_node {
 
 struct tag_stat {
 	struct tag_node tn;
-	struct data_counters counters;
+	struct hlist_node hnode;  /* in iface_stat.tag_stat_hash */
+	struct rcu_head rcu;
+	struct data_counters_pcpu *counters;
 	/*
 	 * If this tag is acct_tag based, we need to count against the
 	 * matching parent uid_tag.
 	 */
-	struct data_counters *parent_counters;
+	struct data_counters_pcpu *parent_counters;
 };
 
 struct iface_stat {
@@ -222,7 +274,7 @@ struct iface_stat {
 	struct net_device *net_dev;
 
 	struct byte_packet_counters totals_via_dev[IFS_MAX_DIRECTIONS];
-	struct data_counters totals_via_skb;
+	struct data_counters_pcpu *totals_via_skb;
 	/*
 	 * We keep the last_known, because some devices reset their counters
 	 * just before NETDEV_UP, while some will reset just before
@@ -238,6 +290,8 @@ struct iface_stat {
 	struct proc_dir_entry *proc_ptr;
 
 	struct rb_root tag_stat_tree;
+	/* Lockless lookups of tag_stat_tree entries; same writers. */
+	struct hlist_head tag_stat_hash[1 << TAG_STAT_HASH_BITS];
 	spinlock_t tag_stat_list_lock;
 };
 
@@ -255,6 +309,8 @@ struct iface_stat_work {
  */
 struct sock_tag {
 	struct rb_node sock_node;
+	struct hlist_node sock_hnode;  /* in sock_tag_hash */
+	struct rcu_head rcu;
 	struct sock *sk;  /* Only used as a number, never dereferenced */
 	/* The socket is needed for sockfd_put() */
 	struct socket *socket;
@@ -262,9 +318,27 @@ struct sock_tag {
 	struct list_head list;   /* in proc_qtu_data.sock_tag_list */
 	pid_t pid;
 
+	/*
+	 * Rewritten by a retag under sock_tag_list_lock while the packet
+	 * path reads it locklessly; 64 bits do not load atomically on
+	 * 32-bit cpus, see sock_tag_read().
+	 */
 	tag_t tag;
+	struct u64_stats_sync tag_syncp;
 };
 
+static inline tag_t sock_tag_read(struct sock_tag *st)
+{
+	unsigned int start;
+	tag_t tag;
+
+	do {
+		start = u64_stats_fetch_begin(&st->tag_syncp);
+		tag = st->tag;
+	} while (u64_stats_fetch_retry(&st->tag_syncp, start));
+	return tag;
+}
+
 struct qtaguid_event_counts {
 	/* Various successful events */
 	atomic64_t sockets_tagged;
@@ -300,6 +374,8 @@ struct qtaguid_event_counts {
 /* Track the set active_set for the given tag. */
 struct tag_counter_set {
 	struct tag_node tn;
+	struct hlist_node hnode;  /* in tag_counter_set_hash */
+	struct rcu_head rcu;
 	int active_set;
 };
 
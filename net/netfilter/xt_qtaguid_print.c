@@ -154,6 +154,8 @@ char *pp_tag_stat(struct tag_stat *ts)
 	char *tn_str;
 	char *counters_str;
 	char *parent_counters_str;
+	struct data_counters counters;
+	struct data_counters parent_counters;
 	char *res;
 
 	if (!ts) {
@@ -162,8 +164,12 @@ char *pp_tag_stat(struct tag_stat *ts)
 		return res;
 	}
 	tn_str = pp_tag_node(&ts->tn);
-	counters_str = pp_data_counters(&ts->counters, true);
-	parent_counters_str = pp_data_counters(ts->parent_counters, false);
+	dc_pcpu_fold(&counters, ts->counters);
+	counters_str = pp_data_counters(&counters, true);
+	if (ts->parent_counters)
+		dc_pcpu_fold(&parent_counters, ts->parent_counters);
+	parent_counters_str = pp_data_counters(
+		ts->parent_counters ? &parent_counters : NULL, false);
 	res = kasprintf(GFP_ATOMIC,
 			"tag_stat@%p{%s, counters=%s, parent_counters=%s}",
 			ts, tn_str, counters_str, parent_counters_str);
@@ -180,7 +186,8 @@ char *pp_iface_stat(struct iface_stat *is)
 	if (!is) {
 		res = kasprintf(GFP_ATOMIC, "iface_stat@null{}");
 	} else {
-		struct data_counters *cnts = &is->totals_via_skb;
+		struct data_counters counters, *cnts = &counters;
+		dc_pcpu_fold(cnts, is->totals_via_skb);
 		res = kasprintf(GFP_ATOMIC, "iface_stat@%p{"
 				"list=list_head{...}, "
 				"ifname=%s, "